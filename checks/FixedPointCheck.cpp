@@ -0,0 +1,46 @@
+/* FixedPointCheck.cpp
+ *
+ * Checks the fixed-point escape-time kernel against the double one over
+ * the whole set, at the viewer's check size and at its default frame size
+ * and limit, and fails if either is outside Kernel::isWithinTolerance().
+ * Needs only the kernels, so it builds on any platform with SSE2:
+ *
+ *   g++ -std=c++11 -O2 -I../src FixedPointCheck.cpp ../src/Kernel.cpp ../src/Palette.cpp
+ *
+ * Returns 0 if every comparison passed. */
+
+#include "Kernel.h"
+
+#include <cstdio>
+
+struct Grid
+{
+	int width, height, maxIterations;
+};
+
+int main()
+{
+	static const int GRID_COUNT = 2;
+	static const Grid GRIDS[GRID_COUNT] = { { 512, 384, 512 }, { 1024, 768, 768 } };
+
+	int failures = 0;
+
+	for (int i = 0; i < GRID_COUNT; ++i)
+	{
+		const Grid& grid = GRIDS[i];
+		const Kernel::FixedPointComparison comparison = Kernel::compareFixedPoint(-2.0, 1.0, 1.125, -1.125,
+			grid.width, grid.height, grid.maxIterations);
+		const bool passed = Kernel::isWithinTolerance(comparison);
+
+		printf("%s %dx%d, %d iterations: %d of %d exact, %d off by one, %d off by more (limit %d), worst %d, "
+			"fixed %.0f ms, double %.0f ms\n", passed ? "PASS" : "FAIL", grid.width, grid.height, grid.maxIterations,
+			comparison.exact, comparison.points, comparison.offByOne, comparison.offByMore,
+			(int) (Kernel::FIXED_MAX_DIVERGENT * comparison.points), comparison.worstDifference,
+			comparison.fixedMilliseconds, comparison.doubleMilliseconds);
+
+		if (!passed)
+			++failures;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
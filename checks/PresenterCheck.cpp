@@ -0,0 +1,95 @@
+/* PresenterCheck.cpp
+ *
+ * Checks that presenting only the dirty tiles gives the same image as
+ * converting the whole colour buffer every time. Random blocks of tiles
+ * are changed and marked dirty between presents, some presents change
+ * nothing, and the overlay text changes part way through. After every
+ * present the headless presenter's image must equal a full conversion,
+ * and a present with nothing changed must be skipped.
+ * Builds on any platform:
+ *
+ *   g++ -std=c++11 -O2 -I../src PresenterCheck.cpp ../src/Presenter.cpp
+ *
+ * Returns 0 if the check passed. */
+
+#include "Presenter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int main()
+{
+	// Not a whole number of tiles, so edge tiles are partly outside the frame
+	static const int WIDTH = 1000;
+	static const int HEIGHT = 750;
+	static const int PRESENTS = 400;
+
+	TiledBuffer<unsigned int> colours;
+	colours.init(WIDTH, HEIGHT);
+	colours.fill(0);
+
+	HeadlessPresenter presenter;
+	presenter.init(WIDTH, HEIGHT);
+
+	std::vector<unsigned int> expected(WIDTH * HEIGHT);
+	std::mt19937 random(1);
+	int failures = 0;
+
+	for (int present = 0; present < PRESENTS && failures == 0; ++present)
+	{
+		const int changes = present % 4 == 3 ? 0 : random() % 20;
+
+		for (int change = 0; change < changes; ++change)
+		{
+			const int lowTileX = random() % colours.getTilesX();
+			const int lowTileY = random() % colours.getTilesY();
+			const int highTileX = std::min(lowTileX + 1 + (int) (random() % 5), colours.getTilesX());
+			const int highTileY = std::min(lowTileY + 1 + (int) (random() % 5), colours.getTilesY());
+
+			for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+			{
+				for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+				{
+					const unsigned int colour = random();
+					unsigned int* tile = colours.getTile(tileX, tileY);
+
+					for (int i = 0; i < TiledBuffer<unsigned int>::TILE_AREA; ++i)
+						tile[i] = colour + i;
+
+					presenter.markDirty(tileX, tileY);
+				}
+			}
+		}
+
+		// A new overlay dirties the tiles under it, so those presents are not idle
+		const bool overlayChanged = present == 0 || present == PRESENTS / 2;
+		presenter.setOverlay(present < PRESENTS / 2 ? "Max Iterations: 256" : "Max Iterations: 1024 (auto)");
+
+		const bool shown = presenter.present(colours);
+
+		if (present > 0 && changes == 0 && !overlayChanged && shown)
+		{
+			printf("FAIL present %d showed a frame with nothing changed\n", present);
+			++failures;
+		}
+
+		colours.toLinear(&expected[0], WIDTH);
+
+		if (presenter.getImage() != expected)
+		{
+			printf("FAIL present %d differs from a full conversion\n", present);
+			++failures;
+		}
+	}
+
+	const Presenter::Stats stats = presenter.getStats();
+	const double fullBytes = (double) (stats.presents + stats.skipped) * WIDTH * HEIGHT * sizeof(unsigned int);
+
+	printf("%s %d presents, %d skipped, %d rectangles, %d tiles, %.1f MB uploaded against %.1f MB for full conversions\n",
+		failures == 0 ? "PASS" : "FAIL", stats.presents, stats.skipped, stats.rectangles, stats.tiles,
+		stats.bytes / 1048576.0, fullBytes / 1048576.0);
+
+	return failures == 0 ? 0 : 1;
+}
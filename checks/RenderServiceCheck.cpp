@@ -0,0 +1,243 @@
+/* RenderServiceCheck.cpp
+ *
+ * Checks the render service's job handles and scheduling. On a pool of one
+ * worker, so the order tiles are rendered in is the order they are handed
+ * out: a job of higher priority, or raised to it, overtakes a queued one,
+ * interactive jobs overtake batch ones, and jobs of equal priority share
+ * the worker in proportion to their weights. It then cancels a job part way
+ * through, adds continuations before and after jobs finish, stops a
+ * service with a job running, and submits to a service that has stopped
+ * or not started. Needs the worker pool, so it builds with the Windows
+ * toolchain:
+ *
+ *   g++ -std=c++11 -O2 -I../src RenderServiceCheck.cpp ../src/RenderService.cpp
+ *       ../src/WorkerPool.cpp ../src/Kernel.cpp ../src/PackedTiles.cpp
+ *       ../src/Palette.cpp ../src/TileOrder.cpp ../src/Tuning.cpp
+ *
+ * Returns 0 if every check passed. */
+
+#include "RenderService.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+static int failures = 0;
+
+static void check(bool passed, const char* description)
+{
+	printf("%s %s\n", passed ? "PASS" : "FAIL", description);
+
+	if (!passed)
+		++failures;
+}
+
+static RenderRequest makeRequest(int width, int height, int maxIterations)
+{
+	RenderRequest request;
+	request.view.left = -2.0;
+	request.view.right = 1.0;
+	request.view.top = 1.125;
+	request.view.bottom = -1.125;
+	request.view.maxIterations = maxIterations;
+	request.width = width;
+	request.height = height;
+	request.mode = RenderRequest::ESCAPE_TIME;
+	request.smooth = true;
+	request.priorityClass = WorkerPool::BATCH;
+	request.priority = 0;
+	request.weight = 1.0;
+	return request;
+}
+
+static void checkEmptyHandle()
+{
+	const RenderJob job;
+	int continuations = 0;
+
+	job.wait();
+	job.cancel();
+	job.setPriority(1);
+	job.then([&continuations](const RenderJob&) { ++continuations; });
+
+	check(!job.isValid() && job.waitFor(0) && job.getStatus() == RenderJob::CANCELLED &&
+		job.getTilesDone() == 0 && job.getTileCount() == 0 && continuations == 1,
+		"an empty handle behaves as a job cancelled before it started");
+}
+
+static void checkPriorities(RenderService& service)
+{
+	RenderJob low = service.submit(makeRequest(640, 480, 2000));
+	RenderRequest request = makeRequest(160, 120, 2000);
+	request.priority = 5;
+	RenderJob high = service.submit(request);
+
+	high.wait();
+	check(high.getStatus() == RenderJob::COMPLETE && low.getTilesDone() < low.getTileCount(),
+		"a job of higher priority overtakes one queued before it");
+	low.wait();
+
+	// Raised while both are queued, the later job goes first
+	RenderJob first = service.submit(makeRequest(640, 480, 2000));
+	RenderJob second = service.submit(makeRequest(640, 480, 2000));
+	second.setPriority(5);
+
+	second.wait();
+	check(second.getStatus() == RenderJob::COMPLETE && first.getTilesDone() < first.getTileCount(),
+		"a job raised to a higher priority overtakes one of the old priority");
+	first.wait();
+
+	RenderJob batch = service.submit(makeRequest(640, 480, 2000));
+	request.priority = 0;
+	request.priorityClass = WorkerPool::INTERACTIVE;
+	RenderJob interactive = service.submit(request);
+
+	interactive.wait();
+	check(interactive.getStatus() == RenderJob::COMPLETE && batch.getTilesDone() < batch.getTileCount(),
+		"an interactive job overtakes a batch one");
+	batch.wait();
+}
+
+static void checkWeights(RenderService& service)
+{
+	std::atomic<int> lightTiles(0);
+	std::atomic<int> lightAtHalf(-1);
+
+	RenderRequest request = makeRequest(640, 480, 1000);
+	RenderRequest heavyRequest = request;
+	heavyRequest.weight = 3.0;
+	heavyRequest.onTile = [&](const RenderJob& job, int, int, int tilesDone)
+	{
+		if (tilesDone == job.getTileCount() / 2)
+			lightAtHalf = lightTiles.load();
+	};
+
+	request.onTile = [&](const RenderJob&, int, int, int) { ++lightTiles; };
+
+	RenderJob heavy = service.submit(heavyRequest);
+	RenderJob light = service.submit(request);
+	heavy.wait();
+	light.wait();
+
+	// Tiles are handed out a unit at a time, so the split is only roughly 3 to 1
+	const int expected = heavy.getTileCount() / 6;
+	printf("     light job had %d tiles when the heavy job had %d, expected about %d\n",
+		lightAtHalf.load(), heavy.getTileCount() / 2, expected);
+	check(lightAtHalf > expected / 2 && lightAtHalf < expected * 2,
+		"jobs of equal priority share the worker in proportion to their weights");
+}
+
+static void checkCancel(RenderService& service)
+{
+	static const int CANCEL_AT = 10;
+
+	RenderRequest request = makeRequest(640, 480, 2000);
+	request.onTile = [](const RenderJob& job, int, int, int tilesDone)
+	{
+		if (tilesDone == CANCEL_AT)
+			job.cancel();
+	};
+
+	RenderJob job = service.submit(request);
+	job.wait();
+	check(job.getStatus() == RenderJob::CANCELLED && job.getTilesDone() >= CANCEL_AT &&
+		job.getTilesDone() < job.getTileCount(), "a job cancelled part way through stops with the tiles done kept");
+}
+
+static void checkContinuations(RenderService& service)
+{
+	std::atomic<int> before(0);
+	int after = 0;
+	std::thread::id afterThread;
+
+	RenderJob job = service.submit(makeRequest(320, 240, 1000));
+	job.then([&before](const RenderJob&) { ++before; });
+	job.wait();
+
+	// Runs on this thread before then() returns
+	job.then([&](const RenderJob& finished)
+	{
+		++after;
+		afterThread = std::this_thread::get_id();
+		check(finished.getStatus() == RenderJob::COMPLETE, "a continuation sees the job finished");
+	});
+
+	// wait() can return while the finishing worker is still calling continuations
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+	while (before == 0 && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+
+	check(before == 1, "a continuation added while the job runs is called once");
+	check(after == 1 && afterThread == std::this_thread::get_id(),
+		"a continuation added to a finished job is called straight away");
+}
+
+static void checkStop()
+{
+	WorkerPool::Config config;
+	config.pinThreads = false;
+	config.maxNodes = 0;
+	config.workersPerNode = 2;
+
+	RenderService service;
+	const RenderJob early = service.submit(makeRequest(320, 240, 256));
+	check(early.getStatus() == RenderJob::CANCELLED && early.getTilesDone() == 0 && early.waitFor(0),
+		"a job submitted before start() is cancelled with no tiles");
+
+	service.start(config);
+
+	std::atomic<bool> started(false);
+	std::atomic<int> continuations(0);
+	RenderRequest request = makeRequest(2048, 2048, 4000);
+	request.onTile = [&started](const RenderJob&, int, int, int) { started = true; };
+
+	RenderJob running = service.submit(request);
+	running.then([&continuations](const RenderJob&) { ++continuations; });
+
+	while (!started)
+		std::this_thread::yield();
+
+	service.stop();
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+	while (continuations == 0 && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+
+	check(running.waitFor(0) && running.getStatus() == RenderJob::CANCELLED &&
+		running.getTilesDone() < running.getTileCount() && continuations == 1,
+		"stop() cancels a running job and waits for it to finish");
+
+	const RenderJob late = service.submit(request);
+	check(late.getStatus() == RenderJob::CANCELLED && late.getTilesDone() == 0 && late.waitFor(0),
+		"a job submitted after stop() is cancelled with no tiles");
+}
+
+int main()
+{
+	checkEmptyHandle();
+
+	WorkerPool::Config config;
+	config.pinThreads = false;
+	config.maxNodes = 1;
+	config.workersPerNode = 1;
+
+	WorkerPool pool;
+	pool.start(config);
+
+	{
+		RenderService service(&pool);
+		checkPriorities(service);
+		checkWeights(service);
+		checkCancel(service);
+		checkContinuations(service);
+		service.stop();
+	}
+
+	pool.stop();
+	checkStop();
+
+	printf("%s\n", failures == 0 ? "PASS all checks" : "FAIL");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include "GdiPresenter.h"
+
+#include <algorithm>
+
+GdiPresenter::GdiPresenter(Renderer& renderer) : m_renderer(renderer), m_image(nullptr) { }
+
+
+GdiPresenter::~GdiPresenter()
+{
+	if (m_image != nullptr)
+		_aligned_free(m_image);
+}
+
+
+void GdiPresenter::init(int width, int height)
+{
+	Presenter::init(width, height);
+
+	if (m_image != nullptr)
+		_aligned_free(m_image);
+
+	// 32 bit DIB rows are always 4 byte aligned, so the image needs no row padding
+	m_image = (unsigned int*) _aligned_malloc(width * height * sizeof(unsigned int), TiledBuffer<unsigned int>::CACHE_LINE);
+}
+
+
+// The tiles' rows are uploaded as a top-down DIB of their own, starting at
+// the first row, so no source offsets into the whole frame are needed.
+void GdiPresenter::upload(const TiledBuffer<unsigned int>& colours, int lowTileX, int lowTileY,
+						  int highTileX, int highTileY)
+{
+	const int tileSize = TiledBuffer<unsigned int>::TILE_SIZE;
+	const int x = lowTileX * tileSize;
+	const int y = lowTileY * tileSize;
+	const int width = std::min(highTileX * tileSize, m_width) - x;
+	const int height = std::min(highTileY * tileSize, m_height) - y;
+
+	colours.toLinear(m_image, m_width, lowTileX, lowTileY, highTileX, highTileY);
+
+	BITMAPINFO bitmapInfo = *m_renderer.getBitmapInfo();
+	bitmapInfo.bmiHeader.biHeight = -height;
+	bitmapInfo.bmiHeader.biSizeImage = m_width * height * sizeof(unsigned int);
+
+	SetDIBitsToDevice(*m_renderer.getBackHdc(), x, y, width, height, x, 0, 0, height,
+		&m_image[y * m_width], &bitmapInfo, DIB_RGB_COLORS);
+}
+
+
+void GdiPresenter::measureOverlay(const std::string& text, int& width, int& height)
+{
+	SIZE size;
+
+	if (text.empty() || !GetTextExtentPoint32A(*m_renderer.getBackHdc(), text.c_str(), text.size(), &size))
+	{
+		width = 0;
+		height = 0;
+		return;
+	}
+
+	width = size.cx;
+	height = size.cy;
+}
+
+
+void GdiPresenter::drawOverlay(const std::string& text)
+{
+	TextOut(*m_renderer.getBackHdc(), OVERLAY_X, OVERLAY_Y, text.c_str(), text.size());
+}
+
+
+void GdiPresenter::show(int x, int y, int width, int height)
+{
+	m_renderer.push(x, y, width, height);
+}
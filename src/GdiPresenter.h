@@ -0,0 +1,36 @@
+/* GdiPresenter.h
+ *
+ * Presents the colour buffer to the window with GDI. */
+
+#ifndef GDIPRESENTER_H
+#define GDIPRESENTER_H
+
+#include "Presenter.h"
+#include "Renderer.h"
+
+// Presents to the window through the renderer's back buffer, which keeps
+// the last frame between presents.
+class GdiPresenter : public Presenter
+{
+public:
+	explicit GdiPresenter(Renderer& renderer);
+	~GdiPresenter();
+
+	void init(int width, int height);
+
+protected:
+	void upload(const TiledBuffer<unsigned int>& colours, int lowTileX, int lowTileY,
+				int highTileX, int highTileY);
+	void measureOverlay(const std::string& text, int& width, int& height);
+	void drawOverlay(const std::string& text);
+	void show(int x, int y, int width, int height);
+
+private:
+	Renderer& m_renderer;
+
+	// The frame in the linear layout the DIB expects. Only dirty
+	// tiles are converted, the rest keep their last contents.
+	unsigned int* m_image;
+};
+
+#endif // GDIPRESENTER_H
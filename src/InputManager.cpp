@@ -19,6 +19,17 @@ void InputManager::init()
 // [LPARAM] lParam: contains part of the windows event info.
 void InputManager::onWinEvent(UINT msg, WPARAM wParam, LPARAM lParam)
 {
+	if (m_trace != nullptr && (msg == WM_KEYDOWN || msg == WM_KEYUP || msg == WM_MOUSEMOVE || msg == WM_MOUSEWHEEL))
+	{
+		InputEvent event;
+		event.time = (int) (clock() - m_recordStart);
+		event.message = msg;
+		event.wParam = wParam;
+		event.lParam = lParam;
+
+		m_trace->add(event);
+	}
+
 	switch (msg)
 	{
 	case WM_KEYDOWN:
@@ -36,7 +47,7 @@ void InputManager::onWinEvent(UINT msg, WPARAM wParam, LPARAM lParam)
 		break;
 
 	case WM_MOUSEWHEEL:
-		m_mouseWheelDelta = GET_WHEEL_DELTA_WPARAM(wParam);
+		m_mouseWheelDelta += GET_WHEEL_DELTA_WPARAM(wParam);
 	}
 }
 
@@ -82,7 +93,33 @@ int InputManager::getMouseY()
 	return m_mouseY;
 }
 
+// Returns the wheel movement accumulated since it was last taken.
 int InputManager::getMouseWheelDelta()
 {
 	return m_mouseWheelDelta;
+}
+
+
+// Returns the accumulated wheel movement and resets it, so
+// that each notch is only acted on once.
+int InputManager::takeMouseWheelDelta()
+{
+	int delta = m_mouseWheelDelta;
+	m_mouseWheelDelta -= delta;
+
+	return delta;
+}
+
+
+// Starts recording events to a trace, timed from now.
+void InputManager::startRecording(InputTrace* trace)
+{
+	m_recordStart = clock();
+	m_trace = trace;
+}
+
+
+void InputManager::stopRecording()
+{
+	m_trace = nullptr;
 }
\ No newline at end of file
@@ -5,14 +5,17 @@
 #ifndef INPUTMANAGER_H
 #define INPUTMANAGER_H
 
+#include "InputTrace.h"
 #include "Keys.h"
 #include "windows.h"
 
+#include <ctime>
+
 class InputManager
 {
 public:
 	// Uses an initialization list to set the mouse x- and y-coords.
-	InputManager() : m_mouseX(0), m_mouseY(0) { }
+	InputManager() : m_mouseX(0), m_mouseY(0), m_mouseWheelDelta(0), m_trace(nullptr), m_recordStart(0) { }
 
 	void init();
 
@@ -26,6 +29,11 @@ public:
 	int getMouseY();
 
 	int getMouseWheelDelta();
+	int takeMouseWheelDelta();
+
+	// Appends every event received from now on to a trace.
+	void startRecording(InputTrace* trace);
+	void stopRecording();
 
 private:
 	// Bool array containing keydown flags.
@@ -37,8 +45,12 @@ private:
 	// Mouse x- and y-coords.
 	int m_mouseX, m_mouseY;
 
-	// 
+	// Wheel movement accumulated since it was last taken, in WHEEL_DELTA units.
 	int m_mouseWheelDelta;
+
+	// Trace being recorded to, or nullptr.
+	InputTrace* m_trace;
+	clock_t m_recordStart;
 };
 
 #endif // INPUTMANAGER_H
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "InputTrace.h"
+
+#include <fstream>
+#include <string>
+
+// First word of a trace, followed by the start session on the same line.
+static const char* TRACE_HEADER = "MandelbrotViewerTrace";
+
+void InputTrace::clear()
+{
+	m_events.clear();
+	m_next = 0;
+}
+
+
+void InputTrace::add(const InputEvent& event)
+{
+	m_events.push_back(event);
+}
+
+
+// Writes the start session, with the view's coordinates at full precision
+// so that replays start from exactly the same view, then one event per line.
+bool InputTrace::save(const char* path) const
+{
+	std::ofstream file(path);
+
+	if (!file)
+		return false;
+
+	file.precision(17);
+
+	file << TRACE_HEADER << " " << m_start.view.left << " " << m_start.view.right << " "
+		<< m_start.view.top << " " << m_start.view.bottom << " " << m_start.view.maxIterations << " "
+		<< m_start.manualIterations << " " << m_start.autoIterations << " " << m_start.zoomFactor << " "
+		<< m_start.renderMode << " " << m_start.paletteIndex << "\n";
+
+	for (std::vector<InputEvent>::const_iterator iter = m_events.begin();
+		iter != m_events.end(); ++iter)
+	{
+		file << iter->time << " " << iter->message << " " << (unsigned long long) iter->wParam << " "
+			<< (long long) iter->lParam << "\n";
+	}
+
+	return (bool) file;
+}
+
+
+bool InputTrace::load(const char* path)
+{
+	std::ifstream file(path);
+	std::string header;
+
+	clear();
+
+	if (!(file >> header) || header != TRACE_HEADER)
+		return false;
+
+	file >> m_start.view.left >> m_start.view.right >> m_start.view.top >> m_start.view.bottom
+		>> m_start.view.maxIterations >> m_start.manualIterations >> m_start.autoIterations
+		>> m_start.zoomFactor >> m_start.renderMode >> m_start.paletteIndex;
+
+	if (!file)
+		return false;
+
+	m_start.refinementStep = 0;
+
+	InputEvent event;
+	unsigned long long wParam;
+	long long lParam;
+
+	while (file >> event.time >> event.message >> wParam >> lParam)
+	{
+		event.wParam = (WPARAM) wParam;
+		event.lParam = (LPARAM) lParam;
+		m_events.push_back(event);
+	}
+
+	return file.eof();
+}
+
+
+void InputTrace::setStart(const Snapshot::Session& start)
+{
+	m_start = start;
+}
+
+
+const Snapshot::Session& InputTrace::getStart() const
+{
+	return m_start;
+}
+
+
+const InputEvent* InputTrace::next(int time)
+{
+	if (m_next >= (int) m_events.size() || m_events[m_next].time > time)
+		return nullptr;
+
+	return &m_events[m_next++];
+}
+
+
+bool InputTrace::isFinished() const
+{
+	return m_next >= (int) m_events.size();
+}
+
+
+int InputTrace::getEventCount() const
+{
+	return (int) m_events.size();
+}
@@ -0,0 +1,54 @@
+/* InputTrace.h
+ *
+ * A timestamped trace of the window events InputManager receives,
+ * along with the session they started from, so that a session can be
+ * recorded once and replayed the same way against any build.
+ * Traces are plain text, one event per line. */
+
+#ifndef INPUTTRACE_H
+#define INPUTTRACE_H
+
+#include "Snapshot.h"
+
+#include "windows.h"
+
+#include <vector>
+
+struct InputEvent
+{
+	// Milliseconds since the recording started.
+	int time;
+
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+};
+
+class InputTrace
+{
+public:
+	InputTrace() : m_next(0) { }
+
+	void clear();
+	void add(const InputEvent& event);
+
+	bool save(const char* path) const;
+	bool load(const char* path);
+
+	// The session the recording started from.
+	void setStart(const Snapshot::Session& start);
+	const Snapshot::Session& getStart() const;
+
+	// Returns the next event due by a time, or nullptr if there is none yet.
+	const InputEvent* next(int time);
+	bool isFinished() const;
+
+	int getEventCount() const;
+
+private:
+	Snapshot::Session m_start;
+	std::vector<InputEvent> m_events;
+	int m_next;
+};
+
+#endif // INPUTTRACE_H
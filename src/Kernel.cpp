@@ -0,0 +1,335 @@
+#include "Kernel.h"
+#include "Palette.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <emmintrin.h>
+
+namespace Kernel
+{
+	// Escape radius of the distance estimate kernel. A larger radius than the
+	// escape-time kernel's makes the estimate more accurate.
+	static const double DISTANCE_BAILOUT = 256.0;
+
+	// The fixed-point kernel stores values as signed 32 bit integers with
+	// FIXED_FRACTION_BITS fractional bits, which covers [-8, 8).
+	// Points are limited to FIXED_RANGE so that z stays in range until it escapes,
+	// and pixels to FIXED_MIN_SPACING apart, 256 steps of the format, so the
+	// rounding of the arithmetic stays far below a pixel.
+	static const int FIXED_FRACTION_BITS = 28;
+	static const double FIXED_ONE = (double) (1 << FIXED_FRACTION_BITS);
+	static const double FIXED_RANGE = 4.0;
+	static const double FIXED_MIN_SPACING = 256.0 / FIXED_ONE;
+
+	// Escape threshold on |z|^2, as the high 32 bits of a product of two
+	// fixed-point values: 4 with 2 * FIXED_FRACTION_BITS fractional bits is 2^58.
+	static const int FIXED_BAILOUT_HIGH = 1 << (2 + 2 * FIXED_FRACTION_BITS - 32);
+
+	// Converts a coordinate to fixed point, rounding to the nearest step.
+	static int toFixed(double value)
+	{
+		return (int) floor(value * FIXED_ONE + 0.5);
+	}
+
+	// Multiplies the low 32 bits of each 64 bit lane as signed values, giving
+	// exact 64 bit products. SSE2 only multiplies unsigned values, so each
+	// negative operand's sign is corrected for by subtracting the other
+	// operand from the high half of the product.
+	static __m128i multiplyFixed(__m128i a, __m128i b)
+	{
+		const __m128i product = _mm_mul_epu32(a, b);
+		const __m128i correction = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b),
+			_mm_and_si128(_mm_srai_epi32(b, 31), a));
+
+		return _mm_sub_epi64(product, _mm_slli_epi64(correction, 32));
+	}
+
+	// Iterates z = z^2 + c, carrying on from z after a number of iterations,
+	// until z moves more than 2 units away from (0, 0) or we've iterated
+	// maxIterations times. Returns the number of iterations, and leaves z at its final value.
+	int escapeTime(std::complex<double> c, int iterations, int maxIterations, std::complex<double>& z)
+	{
+		while (abs(z) < 2.0 && iterations < maxIterations) 
+		{
+			z = (z * z) + c;
+			++iterations;
+		}
+
+		return iterations;
+	}
+
+	// As above, starting off z at (0, 0).
+	int escapeTime(std::complex<double> c, int maxIterations, std::complex<double>& z)
+	{
+		z = std::complex<double>(0.0, 0.0);
+
+		return escapeTime(c, 0, maxIterations, z);
+	}
+
+	// Distance estimate kernel, for two points at once with SSE2.
+	// Alongside z = z^2 + c it iterates the derivative dz/dc = 2 z dz/dc + 1,
+	// stopping each lane once |z| passes DISTANCE_BAILOUT or the iteration limit
+	// is reached. Escaping points get the estimate 2 |z| ln|z| / |dz/dc|, which
+	// by the Koebe quarter theorem is at most four times the true distance to
+	// the set. Points inside the set get -1.
+	void estimateDistances(const double real[2], const double imag[2], int maxIterations, double distances[2])
+	{
+		const __m128d bailout = _mm_set1_pd(DISTANCE_BAILOUT * DISTANCE_BAILOUT);
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d two = _mm_set1_pd(2.0);
+		const __m128d cReal = _mm_loadu_pd(real);
+		const __m128d cImag = _mm_loadu_pd(imag);
+
+		__m128d zReal = _mm_setzero_pd();
+		__m128d zImag = _mm_setzero_pd();
+		__m128d dReal = _mm_setzero_pd();
+		__m128d dImag = _mm_setzero_pd();
+		__m128d iterations = _mm_setzero_pd();
+
+		for (int i = 0; i < maxIterations; ++i)
+		{
+			const __m128d zReal2 = _mm_mul_pd(zReal, zReal);
+			const __m128d zImag2 = _mm_mul_pd(zImag, zImag);
+			const __m128d active = _mm_cmplt_pd(_mm_add_pd(zReal2, zImag2), bailout);
+
+			if (_mm_movemask_pd(active) == 0)
+				break;
+
+			const __m128d nextDReal = _mm_add_pd(_mm_mul_pd(two, 
+				_mm_sub_pd(_mm_mul_pd(zReal, dReal), _mm_mul_pd(zImag, dImag))), one);
+			const __m128d nextDImag = _mm_mul_pd(two, 
+				_mm_add_pd(_mm_mul_pd(zReal, dImag), _mm_mul_pd(zImag, dReal)));
+			const __m128d nextZReal = _mm_add_pd(_mm_sub_pd(zReal2, zImag2), cReal);
+			const __m128d nextZImag = _mm_add_pd(_mm_mul_pd(two, _mm_mul_pd(zReal, zImag)), cImag);
+
+			// Lanes that have escaped keep their final values
+			dReal = _mm_or_pd(_mm_and_pd(active, nextDReal), _mm_andnot_pd(active, dReal));
+			dImag = _mm_or_pd(_mm_and_pd(active, nextDImag), _mm_andnot_pd(active, dImag));
+			zReal = _mm_or_pd(_mm_and_pd(active, nextZReal), _mm_andnot_pd(active, zReal));
+			zImag = _mm_or_pd(_mm_and_pd(active, nextZImag), _mm_andnot_pd(active, zImag));
+			iterations = _mm_add_pd(iterations, _mm_and_pd(active, one));
+		}
+
+		double laneZReal[2], laneZImag[2], laneDReal[2], laneDImag[2], laneIterations[2];
+		_mm_storeu_pd(laneZReal, zReal);
+		_mm_storeu_pd(laneZImag, zImag);
+		_mm_storeu_pd(laneDReal, dReal);
+		_mm_storeu_pd(laneDImag, dImag);
+		_mm_storeu_pd(laneIterations, iterations);
+
+		for (int lane = 0; lane < 2; ++lane)
+		{
+			if (laneIterations[lane] >= (double) maxIterations)
+			{
+				distances[lane] = -1.0;
+				continue;
+			}
+
+			const double z = sqrt(laneZReal[lane] * laneZReal[lane] + laneZImag[lane] * laneZImag[lane]);
+			const double dz = sqrt(laneDReal[lane] * laneDReal[lane] + laneDImag[lane] * laneDImag[lane]);
+			const double distance = 2.0 * z * log(z) / dz;
+
+			// A derivative that overflowed means the point is right on the boundary
+			distances[lane] = distance > 0.0 ? distance : 0.0;
+		}
+	}
+
+	// Maps a distance estimate onto the palettes' range of escape times.
+	// Pixels on the boundary take the top of the range, and the shade falls away
+	// logarithmically to 0 at DISTANCE_SATURATION pixels. Points inside the set
+	// take the iteration limit, like in the escape-time mode.
+	float distanceShade(double distance, double pixelSpacing, int maxIterations)
+	{
+		if (distance < 0.0)
+			return (float) maxIterations;
+
+		const double pixels = std::min(distance / pixelSpacing, DISTANCE_SATURATION);
+		const double highest = (double) maxIterations - 1.0 / (double) Palette::LUT_SCALE;
+
+		return (float) (highest * (1.0 - log2(1.0 + pixels) / log2(1.0 + DISTANCE_SATURATION)));
+	}
+
+	float sampleEscapeTime(std::complex<double> c, int maxIterations, bool smooth)
+	{
+		std::complex<double> z;
+		const int iterations = escapeTime(c, maxIterations, z);
+
+		return storedEscapeTime(iterations, abs(z), maxIterations, smooth);
+	}
+
+	// The smoothed count uses how far past the bailout z landed, and is
+	// clamped to stay below maxIterations, which is reserved for the set itself.
+	float storedEscapeTime(int iterations, double magnitude, int maxIterations, bool smooth)
+	{
+		if (!smooth || iterations >= maxIterations)
+			return (float) iterations;
+
+		float smoothed = (float) (iterations + 1 - log2(log2(magnitude)));
+
+		if (smoothed < 0.0f)
+			smoothed = 0.0f;
+
+		if (smoothed > (float) maxIterations - 1.0f / (float) Palette::LUT_SCALE)
+			smoothed = (float) maxIterations - 1.0f / (float) Palette::LUT_SCALE;
+
+		return smoothed;
+	}
+
+	// Returns true if c is inside the main cardioid or the period 2 bulb,
+	// where every point is in the set.
+	bool isInMainBulbs(std::complex<double> c)
+	{
+		const double x = c.real() - 0.25;
+		const double y2 = c.imag() * c.imag();
+		const double q = x * x + y2;
+
+		return q * (q + x) <= 0.25 * y2 || (c.real() + 1.0) * (c.real() + 1.0) + y2 <= 0.0625;
+	}
+
+	bool fixedPointCovers(double left, double right, double top, double bottom, double pixelSpacing)
+	{
+		return std::max(std::max(fabs(left), fabs(right)), std::max(fabs(top), fabs(bottom))) <= FIXED_RANGE &&
+			fabs(pixelSpacing) >= FIXED_MIN_SPACING;
+	}
+
+	// Each point occupies the low 32 bits of a 64 bit lane. Squares and
+	// products are exact in 64 bits, so |z|^2 >= 4 is tested exactly, on the
+	// high half of the sum of squares. While |z| < 2, both parts of z^2 are
+	// below 4 in magnitude and both parts of c at most FIXED_RANGE, so both
+	// parts of the next z are below 8 and stay in the format. The squares
+	// tested for that z are then below 64, 2^62 with 2 * FIXED_FRACTION_BITS
+	// fractional bits, so neither they nor their sum overflows 64 bits.
+	// Shifting the 64 bit products logically keeps the low 32 bits the
+	// same as an arithmetic shift would, and those are all that is kept.
+	void escapeTimesFixed(const double real[2], const double imag[2], int maxIterations,
+						  int iterations[2], double magnitudes[2])
+	{
+		const __m128i cReal = _mm_set_epi32(0, toFixed(real[1]), 0, toFixed(real[0]));
+		const __m128i cImag = _mm_set_epi32(0, toFixed(imag[1]), 0, toFixed(imag[0]));
+		const __m128i bailout = _mm_set1_epi32(FIXED_BAILOUT_HIGH - 1);
+		const __m128i one = _mm_set1_epi32(1);
+
+		__m128i zReal = _mm_setzero_si128();
+		__m128i zImag = _mm_setzero_si128();
+		__m128i active = _mm_set1_epi32(-1);
+		__m128i counts = _mm_setzero_si128();
+
+		for (int i = 0; i < maxIterations; ++i)
+		{
+			const __m128i zReal2 = multiplyFixed(zReal, zReal);
+			const __m128i zImag2 = multiplyFixed(zImag, zImag);
+
+			// Spread each lane's test on the high half over the whole lane
+			const __m128i escaped = _mm_cmpgt_epi32(_mm_add_epi64(zReal2, zImag2), bailout);
+			active = _mm_andnot_si128(_mm_shuffle_epi32(escaped, _MM_SHUFFLE(3, 3, 1, 1)), active);
+
+			if (_mm_movemask_epi8(active) == 0)
+				break;
+
+			const __m128i zRealImag = multiplyFixed(zReal, zImag);
+			const __m128i nextZReal = _mm_add_epi32(_mm_srli_epi64(_mm_sub_epi64(zReal2, zImag2), FIXED_FRACTION_BITS), cReal);
+			const __m128i nextZImag = _mm_add_epi32(_mm_srli_epi64(zRealImag, FIXED_FRACTION_BITS - 1), cImag);
+
+			// Lanes that have escaped keep their final values
+			zReal = _mm_or_si128(_mm_and_si128(active, nextZReal), _mm_andnot_si128(active, zReal));
+			zImag = _mm_or_si128(_mm_and_si128(active, nextZImag), _mm_andnot_si128(active, zImag));
+			counts = _mm_add_epi32(counts, _mm_and_si128(active, one));
+		}
+
+		int laneCounts[4], laneZReal[4], laneZImag[4];
+		_mm_storeu_si128((__m128i*) laneCounts, counts);
+		_mm_storeu_si128((__m128i*) laneZReal, zReal);
+		_mm_storeu_si128((__m128i*) laneZImag, zImag);
+
+		for (int lane = 0; lane < 2; ++lane)
+		{
+			const double zr = laneZReal[lane * 2] / FIXED_ONE;
+			const double zi = laneZImag[lane * 2] / FIXED_ONE;
+
+			iterations[lane] = laneCounts[lane * 2];
+			magnitudes[lane] = sqrt(zr * zr + zi * zi);
+		}
+	}
+
+	void sampleEscapeTimesFixed(const double real[2], const double imag[2], int maxIterations,
+								bool smooth, float values[2])
+	{
+		int iterations[2];
+		double magnitudes[2];
+
+		escapeTimesFixed(real, imag, maxIterations, iterations, magnitudes);
+
+		values[0] = storedEscapeTime(iterations[0], magnitudes[0], maxIterations, smooth);
+		values[1] = storedEscapeTime(iterations[1], magnitudes[1], maxIterations, smooth);
+	}
+
+	// Each row is timed through both kernels in turn, pairing columns for the
+	// fixed-point kernel as the viewer does.
+	FixedPointComparison compareFixedPoint(double left, double right, double top, double bottom,
+										   int width, int height, int maxIterations)
+	{
+		FixedPointComparison comparison = { 0, 0, 0, 0, 0, 0.0, 0.0 };
+		std::vector<int> fixedIterations(width);
+		std::vector<int> doubleIterations(width);
+
+		for (int y = 0; y < height; ++y)
+		{
+			const double imag = top + (bottom - top) * y / height;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			for (int x = 0; x < width; x += 2)
+			{
+				const int partner = std::min(x + 1, width - 1);
+				const double pairReal[2] = { left + (right - left) * x / width, left + (right - left) * partner / width };
+				const double pairImag[2] = { imag, imag };
+				int iterations[2];
+				double magnitudes[2];
+
+				escapeTimesFixed(pairReal, pairImag, maxIterations, iterations, magnitudes);
+
+				fixedIterations[x] = iterations[0];
+				fixedIterations[partner] = iterations[1];
+			}
+
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			comparison.fixedMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+			start = end;
+
+			for (int x = 0; x < width; ++x)
+			{
+				std::complex<double> z;
+				doubleIterations[x] = escapeTime(std::complex<double>(left + (right - left) * x / width, imag), maxIterations, z);
+			}
+
+			comparison.doubleMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			for (int x = 0; x < width; ++x)
+			{
+				const int difference = abs(doubleIterations[x] - fixedIterations[x]);
+
+				++comparison.points;
+
+				if (difference == 0)
+					++comparison.exact;
+				else if (difference == 1)
+					++comparison.offByOne;
+				else
+					++comparison.offByMore;
+
+				comparison.worstDifference = std::max(comparison.worstDifference, difference);
+			}
+		}
+
+		return comparison;
+	}
+
+	bool isWithinTolerance(const FixedPointComparison& comparison)
+	{
+		return comparison.points > 0 && comparison.exact >= FIXED_MIN_EXACT * comparison.points &&
+			comparison.offByMore <= FIXED_MAX_DIVERGENT * comparison.points;
+	}
+}
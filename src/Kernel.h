@@ -0,0 +1,94 @@
+/* Kernel.h
+ *
+ * The per-point iteration kernels, shared by the interactive viewer
+ * and the render service. They only depend on the point and the
+ * iteration limit, so any thread can call them.
+ * Shallow views can use a fixed-point escape-time kernel instead of the
+ * double one. Its integer iteration gives the same iteration counts on
+ * every processor and compiler. Smoothed values are still computed from
+ * the final |z| in double precision with the C library's logarithms, so
+ * they are only as reproducible as that library. The fixed-point counts
+ * are not the double kernel's: near the boundary of the set rounding
+ * differences grow, and a few points escape many iterations apart, so
+ * compareFixedPoint() checks the kernels agree within FIXED_MAX_DIVERGENT. */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <complex>
+
+namespace Kernel
+{
+	// Distance, in pixels, beyond which distance shading treats every pixel alike.
+	const double DISTANCE_SATURATION = 64.0;
+
+	// Iterates z = z^2 + c, carrying on from z after a number of iterations,
+	// until z moves more than 2 units away from (0, 0) or we've iterated
+	// maxIterations times. Returns the number of iterations, and leaves z at its final value.
+	int escapeTime(std::complex<double> c, int iterations, int maxIterations, std::complex<double>& z);
+
+	// As above, starting off z at (0, 0).
+	int escapeTime(std::complex<double> c, int maxIterations, std::complex<double>& z);
+
+	// Returns the escape time stored for c, smoothed into a normalised
+	// iteration count if asked. Points in the set get maxIterations.
+	float sampleEscapeTime(std::complex<double> c, int maxIterations, bool smooth);
+
+	// Returns the stored escape time for a point that escaped, or not, after
+	// a number of iterations with z at a final magnitude.
+	float storedEscapeTime(int iterations, double magnitude, int maxIterations, bool smooth);
+
+	// Returns true if the fixed-point kernel can render a region with a
+	// pixel spacing: every point in it lies within FIXED_RANGE of the
+	// origin, and pixels are at least FIXED_MIN_SPACING apart.
+	bool fixedPointCovers(double left, double right, double top, double bottom, double pixelSpacing);
+
+	// Fixed-point escape-time kernel, for two points at once with SSE2 integer
+	// arithmetic. Gives the iterations and final |z| as escapeTime() does; the
+	// bailout test is exact, so they only differ where rounding of z does.
+	void escapeTimesFixed(const double real[2], const double imag[2], int maxIterations,
+						  int iterations[2], double magnitudes[2]);
+
+	// As sampleEscapeTime(), for two points with the fixed-point kernel.
+	void sampleEscapeTimesFixed(const double real[2], const double imag[2], int maxIterations,
+								bool smooth, float values[2]);
+
+	// How the fixed-point kernel's escape times compare with the double
+	// kernel's over a grid of points, and how long each kernel took.
+	struct FixedPointComparison
+	{
+		int points;
+		int exact;
+		int offByOne;
+		int offByMore;
+		int worstDifference;
+		double fixedMilliseconds;
+		double doubleMilliseconds;
+	};
+
+	// Tolerance of the comparison: at least FIXED_MIN_EXACT of the points must
+	// escape at the same iteration, and at most FIXED_MAX_DIVERGENT may differ
+	// by more than one iteration.
+	const double FIXED_MIN_EXACT = 0.99;
+	const double FIXED_MAX_DIVERGENT = 0.005;
+
+	// Compares the kernels over a width x height grid of pixel corners spanning a region.
+	FixedPointComparison compareFixedPoint(double left, double right, double top, double bottom,
+										   int width, int height, int maxIterations);
+
+	// Returns true if a comparison is within the tolerance above.
+	bool isWithinTolerance(const FixedPointComparison& comparison);
+
+	// Distance estimate kernel, for two points at once with SSE2.
+	// Points inside the set get -1.
+	void estimateDistances(const double real[2], const double imag[2], int maxIterations, double distances[2]);
+
+	// Maps a distance estimate onto the palettes' range of escape times.
+	float distanceShade(double distance, double pixelSpacing, int maxIterations);
+
+	// Returns true if c is inside the main cardioid or the period 2 bulb,
+	// where every point is in the set.
+	bool isInMainBulbs(std::complex<double> c);
+}
+
+#endif // KERNEL_H
@@ -1,17 +1,128 @@
 #include "MandelbrotViewer.h"
+#include "GdiPresenter.h"
 #include "Helpers.h"
+#include "Kernel.h"
 
 #include <complex>
 #include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
 
-MandelbrotViewer::MandelbrotViewer(HWND handle) : m_renderer(handle) { }
+#include <emmintrin.h>
 
-MandelbrotViewer::~MandelbrotViewer()
+// Order in which the 4x4 sub-pixel strata are visited by the anti-aliasing pass.
+// The first entry is the original corner sample; the next three cover the
+// remaining quadrants so that an early exit after AA_MIN_SAMPLES is still
+// spread evenly over the pixel.
+static const int AA_STRATA_ORDER[16] = { 0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12 };
+
+// Fraction of the view's size kept per notch of the mouse wheel.
+static const double WHEEL_ZOOM_PER_NOTCH = 0.8;
+
+// How far, in rows, a view may be from lining up with its mirror image
+// and still be mirrored. Far below anything visible.
+static const double MIRROR_TOLERANCE = 1e-6;
+
+// Chance that the orbit sampler mutates its current point rather than
+// proposing a fresh one, and the size of a mutation relative to the view width.
+static const double ORBIT_MUTATION_CHANCE = 0.8;
+static const double ORBIT_MUTATION_SCALE = 0.05;
+
+static const char* SNAPSHOT_PATH = "session.mbs";
+
+static const char* RENDER_MODE_NAMES[] = { "escape time", "distance estimate", "Buddhabrot", "anti-Buddhabrot" };
+
+// Fraction of the auto-iteration grid that may still escape in a doubling
+// of the limit before the limit stops rising, the percentile of the grid's
+// escape times the limit is based on, and the headroom given above it.
+static const double AUTO_ESCAPE_FRACTION = 0.005;
+static const double AUTO_PERCENTILE = 0.99;
+static const double AUTO_HEADROOM = 2.0;
+
+// A new limit within this fraction of the last one keeps the last one, so
+// panning does not re-render, or miss the speculative cache, for a few iterations.
+static const double AUTO_HYSTERESIS = 0.25;
+
+// Width of the starting view. Zoom depth is counted in halvings of it.
+static const double AUTO_REFERENCE_WIDTH = 3.0;
+
+// Fraction of the frame budget the auto-iteration grid may take before the
+// limit stops rising, so that a deep view is not held back by its own probe.
+static const double AUTO_BUDGET_FRACTION = 0.25;
+
+static bool isOrbitMode(MandelbrotViewer::RenderMode mode)
+{
+	return mode == MandelbrotViewer::BUDDHABROT_MODE || mode == MandelbrotViewer::ANTI_BUDDHABROT_MODE;
+}
+
+// Returns a repeatable pseudo-random value in [0, 1) for a pixel sample.
+// Hashing the coordinates keeps the jitter identical between renders of
+// the same view, so anti-aliased frames do not shimmer.
+static double sampleJitter(int x, int y, int sample)
+{
+	unsigned int hash = (unsigned int) x * 73856093u ^ (unsigned int) y * 19349663u ^ (unsigned int) sample * 83492791u;
+
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+
+	return (double) (hash & 0xFFFFFF) / (double) 0x1000000;
+}
+
+// Returns the change from one view to another.
+static View viewDifference(const View& from, const View& to)
+{
+	View difference;
+	difference.left = to.left - from.left;
+	difference.right = to.right - from.right;
+	difference.top = to.top - from.top;
+	difference.bottom = to.bottom - from.bottom;
+	difference.maxIterations = to.maxIterations - from.maxIterations;
+
+	return difference;
+}
+
+// Returns a view moved on by a number of steps. Each step is applied in
+// turn, as repeating the input would, but the sums can round differently
+// from the input's own, so the view cache matches views to within a
+// fraction of a pixel rather than exactly.
+static View offsetView(const View& view, const View& step, int times)
 {
-	delete m_rawImageData;
+	View offset = view;
+
+	for (int i = 0; i < times; ++i)
+	{
+		offset.left += step.left;
+		offset.right += step.right;
+		offset.top += step.top;
+		offset.bottom += step.bottom;
+		offset.maxIterations += step.maxIterations;
+	}
+
+	return offset;
+}
+
+MandelbrotViewer::MandelbrotViewer(HWND handle) : m_recording(false), m_replaying(false), m_benchmarking(false),
+	m_renderer(handle),
+	m_presenter(nullptr) { }
 
+MandelbrotViewer::~MandelbrotViewer()
+{
 	m_computeThreadInterrupt = true;
-	joinComputeThreads();
+	m_pool.stop();
+
+	if (m_recording)
+	{
+		m_inputMgr.stopRecording();
+
+		m_log.lockMutex();
+		m_log.write(m_trace.save(m_tracePath.c_str()) ? "\nInput trace saved to " : "\nInput trace could not be saved to ");
+		m_log.write(m_tracePath);
+		m_log.unlockMutex();
+	}
 
 	if (m_renderThread != nullptr)
 	{
@@ -26,6 +137,14 @@ MandelbrotViewer::~MandelbrotViewer()
 		m_updateThread->join();
 		delete m_updateThread;
 	}
+
+	delete m_presenter;
+
+	for (std::vector<Palette*>::iterator iter = m_palettes.begin();
+		iter != m_palettes.end(); ++iter)
+	{
+		delete (*iter);
+	}
 }
 
 // Initializes various manager classes, loads textures, and sets up
@@ -35,11 +154,37 @@ void MandelbrotViewer::init()
 {
 	m_state = INIT_STATE;
 	m_maxIterations = 768;
+	m_autoIterations = AUTO_ITERATIONS;
+	m_fixedPoint = FIXED_POINT;
+	m_autoIterationCount = 0;
 	m_needRedraw = false;
 	m_quitting = false;
 	m_renderThreadInterrupt = false;
 	m_updateThreadInterrupt = false;
 	m_computeThreadInterrupt = false;
+	m_needRecolour = false;
+	m_tileOrdering = INTERACTIVE_ORDERING;
+	m_frameBudget = FRAME_BUDGET;
+	m_speculating = false;
+	m_speculationInterrupt = false;
+	m_speculationTime = 0;
+	m_hasNavigationStep = false;
+	m_hasPreviousFrame = false;
+	m_mirrorSum = 0;
+	m_mirrorLow = 0;
+	m_mirrorHigh = 0;
+	m_renderMode = ESCAPE_TIME_MODE;
+	m_frameMode = ESCAPE_TIME_MODE;
+	m_orbitBatch = 0;
+	m_hasRestoredFrame = false;
+	m_needSnapshot = false;
+	m_snapshotCurrent = false;
+	m_lastCheckpoint = clock();
+	m_replayFinished = false;
+	m_inputPending = false;
+	m_interactionOpen = false;
+	m_cancelledFrames = 0;
+	m_cancelledTime = 0;
 
 	if (BENCHMARK)
 	{
@@ -61,12 +206,75 @@ void MandelbrotViewer::init()
 		m_zoomFactor = 0.1;
 	}
 
+	m_frameView = getCurrentView();
+
 	// Initialize the helpers
 	m_renderer.init();
 	m_inputMgr.init();
 
-	// Initialise the array for pixel data based on screen size
-	m_rawImageData = new unsigned char[m_renderer.getFrameWidth() * m_renderer.getFrameHeight() * 3];
+	// Initialise the buffers for pixel data based on screen size.
+	// The compute passes only store escape times, which are coloured separately.
+	m_iterationData.init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+	m_colourData.init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+
+	// The anti-aliasing pass compares against an untouched copy of the 1-spp escape times
+	m_aliasedIterationData.init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+	m_previewMask.init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+	m_exteriorTiles.assign(m_iterationData.getTilesX() * m_iterationData.getTilesY(), 0);
+
+	// Replays are headless, so they present to memory, which still measures presentation
+	if (m_replaying)
+		m_presenter = new HeadlessPresenter();
+	else
+		m_presenter = new GdiPresenter(m_renderer);
+
+	m_presenter->init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+
+	for (unsigned int i = 0; i < THREAD_COUNT_X * THREAD_COUNT_Y; ++i)
+		m_orbitHistograms[i].init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+
+	if (SPECULATION)
+	{
+		m_viewCache.init(SPECULATION_CACHE_SIZE, m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+		m_speculativeData.init(m_renderer.getFrameWidth(), m_renderer.getFrameHeight());
+	}
+
+	startWorkers(NUMA_NODE_LIMIT);
+
+	// Clear the buffers from the workers that own each slice, so the
+	// pages are first touched, and therefore placed, on the right node.
+	startComputeThreads(&MandelbrotViewer::clearSlice);
+	joinComputeThreads();
+
+	if (m_benchmarking)
+	{
+		runScalingBenchmark();
+		runOrderingBenchmark();
+		runFixedPointCheck();
+	}
+
+	m_palettes.push_back(new ClassicPalette());
+	m_palettes.push_back(new GradientPalette());
+	m_palettes.push_back(new HistogramPalette());
+	m_paletteIndex = 0;
+	m_sliceHistograms.resize(THREAD_COUNT_X * THREAD_COUNT_Y);
+
+	// A replay starts from the recorded session rather than the last one
+	if (m_replaying)
+		applySession(m_trace.getStart());
+	else if (RESTORE_SESSION)
+		restoreSnapshot();
+
+	if (m_recording)
+	{
+		m_trace.setStart(getSession(0));
+		m_inputMgr.startRecording(&m_trace);
+	}
+
+	// Build the first palette without a histogram, so there is
+	// something to preview the first frame with.
+	m_palettes[m_paletteIndex]->build(m_maxIterations, std::vector<unsigned int>());
+	m_builtPaletteIndex = m_paletteIndex;
 
 	// Start a thread to render the set
 	m_renderThread = new std::thread(&MandelbrotViewer::render, this);
@@ -76,6 +284,7 @@ void MandelbrotViewer::init()
 	m_log.unlockMutex();
 
 	// Start a thread to handle user input
+	m_replayStart = clock();
 	m_updateThread = new std::thread(&MandelbrotViewer::update, this);
 
 	m_log.lockMutex();
@@ -92,42 +301,228 @@ void MandelbrotViewer::run()
 	{
 	case INIT_STATE:
 
-		m_needRedraw = false;
-		m_computeThreadInterrupt = false;
-		memset(m_rawImageData, 0, m_renderer.getFrameWidth() * m_renderer.getFrameHeight() * 3);
+		startFrame();
+
+		break;
+
+	case GENERATING_STATE:
+
+		if (!m_pool.waitFor(m_sliceGroups[WorkerPool::INTERACTIVE], UPDATE_DELAY))
+		{
+			// Once a whole level is on screen and the frame has used its budget,
+			// new input supersedes the rest of the frame.
+			if (m_needRedraw && hasCompleteFrame() && clock() - m_computeTimer >= m_frameBudget)
+			{
+				m_computeThreadInterrupt = true;
+			}
+
+			break;
+		}
+
+		if (isOrbitMode(m_frameMode))
+		{
+			finishOrbitBatch();
+			break;
+		}
+
+		if (m_computeThreadInterrupt || m_quitting)
+		{
+			m_log.lockMutex();
+			m_log.write("\nFrame superseded at refinement level ");
+			m_log.write(Helpers::toString(m_refinementStep * 2));
+			m_log.write(" after ");
+			m_log.write(Helpers::toString((int) (clock() - m_computeTimer)));
+			m_log.write(" ms");
+			m_log.unlockMutex();
+
+			if (!m_quitting)
+			{
+				onFrameCancelled();
+				m_state = INIT_STATE;
+			}
+
+			break;
+		}
+
+		// Fill in the rows that mirror the computed half
+		if (m_mirrorHigh > m_mirrorLow)
+		{
+			startComputeThreads(&MandelbrotViewer::mirrorSlice);
+			joinComputeThreads();
+		}
+
+		// The buffer now holds a complete image of m_frameView
+		m_hasPreviousFrame = true;
+		onFrameShown();
+
+		// Checkpoint long frames, and frames a snapshot was asked for, at each
+		// level. The first preview pass leaves parts of the preview behind.
+		if (m_previewPass != 1 && (m_needSnapshot || 
+			clock() - std::max(m_lastCheckpoint, m_computeTimer) >= CHECKPOINT_INTERVAL))
+		{
+			saveSnapshot(m_previewPass == 2 ? 1 : m_refinementStep);
+		}
 
 		m_log.lockMutex();
-		m_log.write("\nPixel data cleared, drawing the set anew");
-		m_log.unlockMutex();
 
-		m_computeTimer = clock();
-		startComputeThreads();
-		m_state = GENERATING_STATE;
+		if (m_previewPass != 0)
+		{
+			m_log.write("\nPreview pass ");
+			m_log.write(Helpers::toString(m_previewPass));
+		}
+		else
+		{
+			m_log.write("\nRefinement level ");
+			m_log.write(Helpers::toString(m_refinementStep));
+		}
 
-		break;
+		m_log.write(" complete after ");
+		m_log.write(Helpers::toString((int) (clock() - m_computeTimer)));
+		m_log.write(" ms");
+		m_log.unlockMutex();
 
-	case GENERATING_STATE:
+		if (m_needRedraw && clock() - m_computeTimer >= m_frameBudget)
+		{
+			onFrameCancelled();
+			m_state = INIT_STATE;
+			break;
+		}
 
-		joinComputeThreads();
-		m_computeThreads.clear();
+		if (m_previewPass == 1)
+		{
+			// The unreliable pixels are done, now replace the rest of the preview
+			m_previewPass = 2;
+			startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+			break;
+		}
+
+		if (m_refinementStep > 1)
+		{
+			// Refine further in the background until superseded
+			m_refinementStep /= 2;
+			startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+			break;
+		}
 
 		m_log.lockMutex();
 		m_log.write("\nSet complete, set took ");
-		m_log.write(Helpers::toString(clock() - m_computeTimer));
+		m_log.write(Helpers::toString((int) (clock() - m_computeTimer)));
 		m_log.write(" ms total");
+
+		if (m_frameMode == DISTANCE_MODE)
+		{
+			m_log.write(", ");
+			m_log.write(Helpers::toString((int) m_exteriorTileCount));
+			m_log.write(" tiles proven exterior");
+		}
+
 		m_log.unlockMutex();
 
+		if (ANTIALIASING)
+		{
+			m_aliasedIterationData.copyFrom(m_iterationData);
+			m_aaExtraSamples = 0;
+			m_aaPixels = 0;
+			m_aaDistanceRejects = 0;
+
+			m_antialiasTimer = clock();
+			startComputeThreads(&MandelbrotViewer::computeAntialiasing);
+			m_state = ANTIALIASING_STATE;
+		}
+		else if (!m_quitting)
+		{
+			startColouring();
+		}
+
+		break;
+
+	case ANTIALIASING_STATE:
+
+		joinComputeThreads();
+
+		{
+			const int pixelCount = m_renderer.getFrameWidth() * m_renderer.getFrameHeight();
+			const int bruteForceSamples = pixelCount * (AA_MAX_SAMPLES - 1);
+
+			m_log.lockMutex();
+			m_log.write("\nAnti-aliasing complete, refined ");
+			m_log.write(Helpers::toString((int) m_aaPixels));
+			m_log.write(" of ");
+			m_log.write(Helpers::toString(pixelCount));
+			m_log.write(" pixels using ");
+			m_log.write(Helpers::toString((int) m_aaExtraSamples));
+			m_log.write(" extra samples (");
+			m_log.write(Helpers::toString(100.0f * (float) m_aaExtraSamples / (float) bruteForceSamples));
+			m_log.write("% of brute force) in ");
+			m_log.write(Helpers::toString((int) (clock() - m_antialiasTimer)));
+			m_log.write(" ms, ");
+			m_log.write(Helpers::toString((int) m_aaDistanceRejects));
+			m_log.write(" smooth pixels proven clear of the set by the distance estimate");
+			m_log.unlockMutex();
+		}
+
 		if (m_computeThreadInterrupt && !m_quitting)
+		{
+			onFrameCancelled();
 			m_state = INIT_STATE;
-		else
-			m_state = COMPLETE_STATE;
+		}
+		else if (!m_quitting)
+		{
+			startColouring();
+		}
+
+		break;
+
+	case COLOURING_STATE:
+
+		joinComputeThreads();
+
+		m_log.lockMutex();
+		m_log.write("\nColouring complete using the ");
+		m_log.write(m_palettes[m_builtPaletteIndex]->getName());
+		m_log.write(" palette in ");
+		m_log.write(Helpers::toString((int) (clock() - m_colourTimer)));
+		m_log.write(" ms");
+		m_log.unlockMutex();
+
+		// Recolouring a saved frame does not save it again
+		if (!m_snapshotCurrent || m_needSnapshot)
+			saveSnapshot(0);
+
+		logQueueLatency();
+		onFrameComplete();
+		m_state = COMPLETE_STATE;
 
 		break;
 
 	case COMPLETE_STATE:
 
+		// Real work always preempts speculation
+		if (m_needRedraw || m_needRecolour)
+			stopSpeculation();
+
 		if (m_needRedraw)
+		{
 			m_state = INIT_STATE;
+		}
+		else if (m_replaying && m_replayFinished && !m_interactionOpen)
+		{
+			// The whole trace has been replayed and its last frame is complete
+			logInteractionReport();
+			setQuitting(true);
+		}
+		else if (m_needSnapshot)
+		{
+			saveSnapshot(0);
+		}
+		else if (m_needRecolour)
+		{
+			startColouring();
+		}
+		else if (SPECULATION && m_frameMode == ESCAPE_TIME_MODE)
+		{
+			speculate();
+		}
 
 		break;
 	}
@@ -136,11 +531,13 @@ void MandelbrotViewer::run()
 
 // Responsible for receiving windows events.
 // Forwards the events to the input manager.
-void MandelbrotViewer::onWinEvent(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+void MandelbrotViewer::onWinEvent(HWND /* hwnd */, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	if (message == WM_DESTROY)
 		PostQuitMessage(0);
-	else
+	else if (message == WM_PAINT && m_presenter != nullptr)
+		m_presenter->invalidate();
+	else if (!m_replaying)
 		m_inputMgr.onWinEvent(message, wParam, lParam);
 }
 
@@ -151,6 +548,14 @@ bool MandelbrotViewer::isQuitting()
 }
 
 
+// Sets how long a frame may refine before new input supersedes it.
+// Whatever refinement level is complete by then is what stays on screen.
+void MandelbrotViewer::setFrameBudget(int milliseconds)
+{
+	m_frameBudget = milliseconds;
+}
+
+
 void MandelbrotViewer::setQuitting(bool state)
 {
 	if (state)
@@ -164,240 +569,2217 @@ void MandelbrotViewer::setQuitting(bool state)
 }
 
 
-// Returns a pointer to the renderer.
-Renderer* MandelbrotViewer::getRenderer()
+void MandelbrotViewer::recordInput(const char* path)
 {
-	return &m_renderer;
+	m_recording = true;
+	m_tracePath = path;
 }
 
 
-// Starts the computation threads to generate the set
-void MandelbrotViewer::startComputeThreads()
+bool MandelbrotViewer::replayInput(const char* path)
 {
-	if (THREAD_COUNT_X == 0 || THREAD_COUNT_Y == 0)
-	{
-		m_log.write("\nThread bounds invalid, stopping execution");
-		setQuitting(true);
-		return;
-	}
+	m_replaying = m_trace.load(path);
+	m_tracePath = path;
 
-	// Start threads to compute the set
-	for (int x = 0; x < THREAD_COUNT_X; ++x)
-	{
-		for (int y = 0; y < THREAD_COUNT_Y; ++y)
-		{
-			m_log.lockMutex();
-			m_log.write("\nStarting thread ");
-			m_log.write(Helpers::toString(x));
-			m_log.write("-");
-			m_log.write(Helpers::toString(y));
-			m_log.unlockMutex();
+	return m_replaying;
+}
 
-			m_computeThreads.push_back(new std::thread(&MandelbrotViewer::computeMandelbrotSet, this, x, y));
-		}
-	}
+
+bool MandelbrotViewer::isReplaying()
+{
+	return m_replaying;
 }
 
-void MandelbrotViewer::joinComputeThreads()
+
+void MandelbrotViewer::runBenchmarks()
 {
-	for (std::vector<std::thread*>::iterator iter = m_computeThreads.begin(); 
-		iter != m_computeThreads.end(); ++iter)
-	{
-		(*iter)->join();
-		delete (*iter);
-	}
+	m_benchmarking = true;
 }
 
-void MandelbrotViewer::update()
+
+// Starts rendering the current view. The frame continues from a
+// speculative render or a reprojected preview if there is one,
+// and otherwise refines from the coarsest level.
+void MandelbrotViewer::startFrame()
 {
-	while (!m_quitting)
+	m_needRedraw = false;
+	m_needRecolour = false;
+	m_computeThreadInterrupt = false;
+	m_previewPass = 0;
+	resetCentreTracking();
+
+	// Snapshot the view, as input can change it while the frame refines.
+	// The escape times on screen still belong to the previous view.
+	const RenderMode previousFrameMode = m_frameMode;
+	m_previousFrameView = m_frameView;
+	m_frameView = getCurrentView();
+	m_frameMode = m_renderMode;
+	m_exteriorTileCount = 0;
+	m_snapshotCurrent = false;
+
+	// The frame reflects any input up to now, which opens an interaction
+	m_navigationMutex.lock();
+	const bool hasInput = m_inputPending;
+	const clock_t inputTime = m_inputTime;
+	m_inputPending = false;
+	m_navigationMutex.unlock();
+
+	if (hasInput && !m_interactionOpen)
 	{
-		if (m_updateThreadInterrupt)
-			return;
+		m_interactionOpen = true;
+		m_interaction.start = (int) (inputTime - m_replayStart);
+		m_interaction.firstFrame = -1;
+		m_interaction.finalFrame = -1;
+		m_interaction.cancelledFrames = 0;
+		m_interaction.cancelledTime = 0;
+	}
 
-		// Get the current clock time.
-		clock_t time = clock();
+	if (m_autoIterations && !isOrbitMode(m_frameMode))
+		m_frameView.maxIterations = chooseIterations(m_frameView);
 
-		// Only update the MandelbrotViewer logic every UPDATE_DELAY.
-		if (time - m_updateTimer > UPDATE_DELAY)
-		{
-			// This stops the image skewing as the view is zoomed in/out.
-			// It is determined by abs(top) + abs(bottom) / abs(left) + abs(right).
-			const double magicRatio = 0.75;
+	if (m_hasRestoredFrame && resumeRestoredFrame())
+		return;
 
-			if (m_inputMgr.isKeyDown(Keys::UP_ARROW))
-			{
-				if(m_rightSetValue - m_leftSetValue < m_zoomFactor * 5)
-				{
-					m_zoomFactor *= 0.1;
-				}
+	if (isOrbitMode(m_frameMode))
+	{
+		startOrbitFrame();
+		return;
+	}
 
-				m_topSetValue -= m_zoomFactor * magicRatio;
-				m_leftSetValue += m_zoomFactor;
-				m_bottomSetValue += m_zoomFactor * magicRatio;
-				m_rightSetValue -= m_zoomFactor;
-				m_needRedraw = true;
-			}
+	findMirrorRows(m_frameView);
 
-			if (m_inputMgr.isKeyDown(Keys::DOWN_ARROW))
-			{
-				if(m_rightSetValue - m_leftSetValue > m_zoomFactor * 50)
-				{
-					m_zoomFactor *= 10;
-				}
+	m_computeTimer = clock();
+	m_refinementCoarsest = COARSEST_REFINEMENT;
+	m_refinementStep = COARSEST_REFINEMENT;
 
-				m_topSetValue += m_zoomFactor * magicRatio;
-				m_leftSetValue -= m_zoomFactor;
-				m_bottomSetValue -= m_zoomFactor * magicRatio;
-				m_rightSetValue += m_zoomFactor;
-				m_needRedraw = true;
-			}
+	// Speculative renders are only made in the escape-time mode
+	ViewCache::Entry* cached = SPECULATION && m_frameMode == ESCAPE_TIME_MODE ? m_viewCache.find(m_frameView) : nullptr;
 
-			if (m_inputMgr.isKeyDown(Keys::SPACEBAR))
-			{
-				std::string snapshot("\set snapshot: [" +
-					Helpers::toString(m_zoomFactor) +
-					"] " + Helpers::toString(m_topSetValue) + 
-					" " + Helpers::toString(m_bottomSetValue) + 
-					" " + Helpers::toString(m_leftSetValue) +
-					" " + Helpers::toString(m_rightSetValue));
+	if (cached != nullptr)
+	{
+		// Carry on from the finest level the speculative render reached
+		cached->data->unpack(m_iterationData);
+		m_viewCache.markUsed(cached);
+		m_refinementCoarsest = cached->refinementStep;
+		m_refinementStep = cached->refinementStep;
 
-				m_log.lockMutex();
-				m_log.write(snapshot);
-				m_log.unlockMutex();
-			}
+		m_log.lockMutex();
+		m_log.write("\nSpeculative cache hit at refinement level ");
+		m_log.write(Helpers::toString(cached->refinementStep));
+		m_log.unlockMutex();
 
+		logSpeculationStats();
+		onFrameShown();
 
-			if (m_inputMgr.isKeyDown(Keys::W))
-			{
-				m_topSetValue += m_zoomFactor;
-				m_bottomSetValue += m_zoomFactor;
-				m_needRedraw = true;
-			}
+		if (m_refinementStep > 1)
+		{
+			m_refinementStep /= 2;
+			startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+		}
 
-			if (m_inputMgr.isKeyDown(Keys::A))
-			{
-				m_leftSetValue -= m_zoomFactor;
-				m_rightSetValue -= m_zoomFactor;
-				m_needRedraw = true;
-			}
+		m_state = GENERATING_STATE;
+		return;
+	}
 
-			if (m_inputMgr.isKeyDown(Keys::S))
+	// Reproject the previous frame as an instant preview of the new view,
+	// then recompute the pixels whose preview is unreliable first.
+	// If none of the preview is reliable, the coarse levels give a faster first image.
+	bool reprojected = false;
+
+	if (REPROJECTION && m_hasPreviousFrame && previousFrameMode == m_frameMode &&
+		m_previousFrameView.maxIterations == m_frameView.maxIterations)
+	{
+		m_aliasedIterationData.copyFrom(m_iterationData);
+		m_reliablePixels = 0;
+		startComputeThreads(&MandelbrotViewer::reprojectSlice);
+		joinComputeThreads();
+
+		reprojected = m_reliablePixels > 0;
+	}
+
+	if (reprojected)
+	{
+		m_log.lockMutex();
+		m_log.write("\nReprojected the previous frame, ");
+		m_log.write(Helpers::toString((int) m_reliablePixels));
+		m_log.write(" of ");
+		m_log.write(Helpers::toString(m_renderer.getFrameWidth() * m_renderer.getFrameHeight()));
+		m_log.write(" pixels reliable");
+		m_log.unlockMutex();
+
+		onFrameShown();
+		m_previewPass = 1;
+		m_refinementStep = 1;
+		startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+		m_state = GENERATING_STATE;
+		return;
+	}
+
+	// The previous frame is not cleared. The coarsest refinement level
+	// covers every pixel, so it stays on screen until it is replaced.
+	m_log.lockMutex();
+	m_log.write("\nDrawing the set anew");
+	m_log.unlockMutex();
+
+	startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+	m_state = GENERATING_STATE;
+}
+
+// Carries on from the frame restored at startup, if the first frame is of
+// the same view. The restored escape times are already in the buffer.
+// Orbit renders are only restored once complete, as their histograms are not saved.
+// Returns false if the frame has to be drawn anew.
+bool MandelbrotViewer::resumeRestoredFrame()
+{
+	m_hasRestoredFrame = false;
+
+	if (!(m_restoredView == m_frameView) || m_restoredMode != m_frameMode ||
+		(isOrbitMode(m_frameMode) && m_restoredStep != 0))
+	{
+		return false;
+	}
+
+	m_log.lockMutex();
+	m_log.write("\nResuming the restored frame ");
+	m_log.write(m_restoredStep == 0 ? "complete" : ("at refinement level " + Helpers::toString(m_restoredStep)).c_str());
+	m_log.unlockMutex();
+
+	m_computeTimer = clock();
+	m_hasPreviousFrame = !isOrbitMode(m_frameMode);
+	onFrameShown();
+
+	if (m_restoredStep == 0)
+	{
+		m_snapshotCurrent = true;
+		startColouring();
+		return true;
+	}
+
+	findMirrorRows(m_frameView);
+	m_refinementCoarsest = m_restoredStep;
+	m_refinementStep = m_restoredStep;
+
+	if (m_refinementStep > 1)
+	{
+		m_refinementStep /= 2;
+		startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+	}
+
+	m_state = GENERATING_STATE;
+	return true;
+}
+
+// Returns the frame's view and the viewer's settings.
+Snapshot::Session MandelbrotViewer::getSession(int refinementStep)
+{
+	Snapshot::Session session;
+	session.view = m_frameView;
+	session.manualIterations = m_maxIterations;
+	session.autoIterations = m_autoIterations ? 1 : 0;
+	session.zoomFactor = m_zoomFactor;
+	session.renderMode = (int) m_frameMode;
+	session.paletteIndex = m_paletteIndex;
+	session.refinementStep = refinementStep;
+
+	return session;
+}
+
+// Whether a session read back from disk describes a view this viewer can
+// render: finite bounds the right way round, iteration limits within the
+// viewer's, and a refinement step a frame could have stopped at.
+bool MandelbrotViewer::isValidSession(const Snapshot::Session& session) const
+{
+	const View& view = session.view;
+	const int step = session.refinementStep;
+
+	if (!std::isfinite(view.left) || !std::isfinite(view.right) ||
+		!std::isfinite(view.top) || !std::isfinite(view.bottom) ||
+		!(view.left < view.right) || !(view.bottom < view.top))
+		return false;
+
+	if (view.maxIterations < 1 || view.maxIterations > MAX_ITERATIONS ||
+		session.manualIterations < MIN_ITERATIONS || session.manualIterations > MAX_ITERATIONS)
+		return false;
+
+	if (!std::isfinite(session.zoomFactor) || !(session.zoomFactor > 0.0))
+		return false;
+
+	return step >= 0 && step <= COARSEST_REFINEMENT && (step & (step - 1)) == 0;
+}
+
+// Moves the view to a session's and takes on its settings.
+// Settings out of range are left as they are.
+void MandelbrotViewer::applySession(const Snapshot::Session& session)
+{
+	m_leftSetValue = session.view.left;
+	m_rightSetValue = session.view.right;
+	m_topSetValue = session.view.top;
+	m_bottomSetValue = session.view.bottom;
+	m_maxIterations = session.manualIterations;
+	m_autoIterations = session.autoIterations != 0;
+	m_zoomFactor = session.zoomFactor;
+
+	if (session.renderMode >= 0 && session.renderMode < RENDER_MODE_COUNT)
+	{
+		m_renderMode = (RenderMode) session.renderMode;
+		m_frameMode = m_renderMode;
+	}
+
+	if (session.paletteIndex >= 0 && session.paletteIndex < (int) m_palettes.size())
+		m_paletteIndex = session.paletteIndex;
+
+	// The auto iteration limit holds on to the session's one
+	if (m_autoIterations)
+		m_autoIterationCount = session.view.maxIterations;
+
+	m_frameView = session.view;
+}
+
+// Saves the frame's view, the viewer's settings and the escape times.
+// The refinement step is the finest level the buffer holds, or 0 once complete.
+void MandelbrotViewer::saveSnapshot(int refinementStep)
+{
+	const clock_t startTime = clock();
+	const bool saved = Snapshot::save(SNAPSHOT_PATH, getSession(refinementStep), m_iterationData);
+
+	m_needSnapshot = false;
+	m_lastCheckpoint = clock();
+
+	if (saved && refinementStep == 0)
+		m_snapshotCurrent = true;
+
+	m_log.lockMutex();
+	m_log.write("\nSet snapshot: [");
+	m_log.write(Helpers::toString(m_zoomFactor));
+	m_log.write("] ");
+	m_log.write(Helpers::toString(m_frameView.top));
+	m_log.write(" ");
+	m_log.write(Helpers::toString(m_frameView.bottom));
+	m_log.write(" ");
+	m_log.write(Helpers::toString(m_frameView.left));
+	m_log.write(" ");
+	m_log.write(Helpers::toString(m_frameView.right));
+	m_log.write(saved ? " saved to " : " could not be saved to ");
+	m_log.write(SNAPSHOT_PATH);
+	m_log.write(" in ");
+	m_log.write(Helpers::toString((int) (m_lastCheckpoint - startTime)));
+	m_log.write(" ms");
+	m_log.unlockMutex();
+}
+
+// Restores the session saved by the last run, if there is one for a frame of
+// this size. The first frame then resumes from the restored escape times.
+void MandelbrotViewer::restoreSnapshot()
+{
+	const clock_t startTime = clock();
+	Snapshot::Session session;
+
+	if (!Snapshot::load(SNAPSHOT_PATH, session, m_iterationData) || !isValidSession(session) ||
+		session.renderMode < 0 || session.renderMode >= RENDER_MODE_COUNT ||
+		session.paletteIndex < 0 || session.paletteIndex >= (int) m_palettes.size())
+	{
+		// A failed load can leave part of a snapshot in the buffer
+		m_iterationData.fill(-1.0f);
+
+		m_log.lockMutex();
+		m_log.write("\nNo session to restore");
+		m_log.unlockMutex();
+		return;
+	}
+
+	applySession(session);
+
+	m_restoredView = session.view;
+	m_restoredMode = m_renderMode;
+	m_restoredStep = session.refinementStep;
+	m_hasRestoredFrame = true;
+
+	m_log.lockMutex();
+	m_log.write("\nRestored the session from ");
+	m_log.write(SNAPSHOT_PATH);
+	m_log.write(" in ");
+	m_log.write(Helpers::toString((int) (clock() - startTime)));
+	m_log.write(" ms");
+	m_log.unlockMutex();
+}
+
+// Called whenever a new level of the frame's image is on screen.
+// The first after input gives the interaction's first frame latency.
+void MandelbrotViewer::onFrameShown()
+{
+	if (m_interactionOpen && m_interaction.firstFrame < 0)
+		m_interaction.firstFrame = (int) (clock() - m_replayStart) - m_interaction.start;
+}
+
+// Called when a frame has been completed and coloured. It closes the open
+// interaction, unless more input has come in that the frame does not reflect.
+void MandelbrotViewer::onFrameComplete()
+{
+	if (!m_interactionOpen || m_needRedraw)
+		return;
+
+	m_interaction.finalFrame = (int) (clock() - m_replayStart) - m_interaction.start;
+
+	if (m_interaction.firstFrame < 0)
+		m_interaction.firstFrame = m_interaction.finalFrame;
+
+	m_interactions.push_back(m_interaction);
+	m_interactionOpen = false;
+
+	m_log.lockMutex();
+	m_log.write("\nInteraction at ");
+	m_log.write(Helpers::toString(m_interaction.start));
+	m_log.write(" ms: first frame after ");
+	m_log.write(Helpers::toString(m_interaction.firstFrame));
+	m_log.write(" ms, final frame after ");
+	m_log.write(Helpers::toString(m_interaction.finalFrame));
+	m_log.write(" ms, ");
+	m_log.write(Helpers::toString(m_interaction.cancelledFrames));
+	m_log.write(" frames cancelled");
+	m_log.unlockMutex();
+}
+
+// Called when new input supersedes a frame before it completes.
+void MandelbrotViewer::onFrameCancelled()
+{
+	const int wasted = (int) (clock() - m_computeTimer);
+
+	++m_cancelledFrames;
+	m_cancelledTime += wasted;
+
+	if (m_interactionOpen)
+	{
+		++m_interaction.cancelledFrames;
+		m_interaction.cancelledTime += wasted;
+	}
+}
+
+// Summarises the interactions of a replay, so that builds can be
+// compared on the same trace.
+void MandelbrotViewer::logInteractionReport()
+{
+	int firstTotal = 0;
+	int firstWorst = 0;
+	int finalTotal = 0;
+	int finalWorst = 0;
+
+	for (std::vector<Interaction>::const_iterator iter = m_interactions.begin();
+		iter != m_interactions.end(); ++iter)
+	{
+		firstTotal += iter->firstFrame;
+		firstWorst = std::max(firstWorst, iter->firstFrame);
+		finalTotal += iter->finalFrame;
+		finalWorst = std::max(finalWorst, iter->finalFrame);
+	}
+
+	const int count = std::max((int) m_interactions.size(), 1);
+
+	m_log.lockMutex();
+	m_log.write("\nReplayed ");
+	m_log.write(Helpers::toString(m_trace.getEventCount()));
+	m_log.write(" events from ");
+	m_log.write(m_tracePath.c_str());
+	m_log.write(" in ");
+	m_log.write(Helpers::toString((int) (clock() - m_replayStart)));
+	m_log.write(" ms, ");
+	m_log.write(Helpers::toString((int) m_interactions.size()));
+	m_log.write(" interactions");
+	m_log.write("\nFirst frame latency: ");
+	m_log.write(Helpers::toString(firstTotal / count));
+	m_log.write(" ms average, ");
+	m_log.write(Helpers::toString(firstWorst));
+	m_log.write(" ms worst");
+	m_log.write("\nFinal frame latency: ");
+	m_log.write(Helpers::toString(finalTotal / count));
+	m_log.write(" ms average, ");
+	m_log.write(Helpers::toString(finalWorst));
+	m_log.write(" ms worst");
+	m_log.write("\nCancelled frames: ");
+	m_log.write(Helpers::toString(m_cancelledFrames));
+	m_log.write(", ");
+	m_log.write(Helpers::toString(m_cancelledTime));
+	m_log.write(" ms of work discarded, ");
+	m_log.write(Helpers::toString(m_viewCache.getWastedCount()));
+	m_log.write(" speculative renders wasted");
+	m_log.unlockMutex();
+
+	const Presenter::Stats presentStats = m_presenter->getStats();
+
+	m_log.lockMutex();
+	m_log.write("\nPresentation: ");
+	m_log.write(Helpers::toString(presentStats.presents));
+	m_log.write(" presents, ");
+	m_log.write(Helpers::toString(presentStats.skipped));
+	m_log.write(" skipped with nothing changed, ");
+	m_log.write(Helpers::toString(presentStats.tiles));
+	m_log.write(" tiles in ");
+	m_log.write(Helpers::toString(presentStats.rectangles));
+	m_log.write(" rectangles, ");
+	m_log.write(Helpers::toString((float) (presentStats.bytes / (1024.0 * 1024.0))));
+	m_log.write(" MB uploaded");
+	m_log.unlockMutex();
+}
+
+// Starts an orbit density render of the frame's view. The buffer will no
+// longer hold escape times, so the next frame cannot be reprojected from it.
+void MandelbrotViewer::startOrbitFrame()
+{
+	m_hasPreviousFrame = false;
+	m_orbitBatch = 0;
+	m_computeTimer = clock();
+
+	m_log.lockMutex();
+	m_log.write("\nDrawing the ");
+	m_log.write(RENDER_MODE_NAMES[m_frameMode]);
+	m_log.unlockMutex();
+
+	startComputeThreads(&MandelbrotViewer::traceOrbits);
+	m_state = GENERATING_STATE;
+}
+
+// Called when every slice has traced a batch of orbits. The slices'
+// histograms are summed into the orbit density, which is mapped onto
+// escape times for the palettes, then the next batch is started.
+void MandelbrotViewer::finishOrbitBatch()
+{
+	const int samples = (m_orbitBatch + 1) * ORBIT_BATCH_SAMPLES * THREAD_COUNT_X * THREAD_COUNT_Y;
+
+	if (m_computeThreadInterrupt || m_quitting)
+	{
+		m_log.lockMutex();
+		m_log.write("\nOrbit render superseded after ");
+		m_log.write(Helpers::toString(m_orbitBatch));
+		m_log.write(" batches");
+		m_log.unlockMutex();
+
+		if (!m_quitting)
+		{
+			onFrameCancelled();
+			m_state = INIT_STATE;
+		}
+
+		return;
+	}
+
+	startComputeThreads(&MandelbrotViewer::reduceOrbitSlice);
+	joinComputeThreads();
+
+	m_orbitMaxDensity = *std::max_element(m_orbitSliceDensity, m_orbitSliceDensity + THREAD_COUNT_X * THREAD_COUNT_Y);
+
+	startComputeThreads(&MandelbrotViewer::mapOrbitSlice);
+	joinComputeThreads();
+
+	++m_orbitBatch;
+	onFrameShown();
+
+	if (m_needRedraw && clock() - m_computeTimer >= m_frameBudget)
+	{
+		onFrameCancelled();
+		m_state = INIT_STATE;
+		return;
+	}
+
+	if (m_orbitBatch < ORBIT_BATCHES)
+	{
+		startComputeThreads(&MandelbrotViewer::traceOrbits);
+		return;
+	}
+
+	m_log.lockMutex();
+	m_log.write("\nOrbit render complete, traced ");
+	m_log.write(Helpers::toString(samples));
+	m_log.write(" samples in ");
+	m_log.write(Helpers::toString((int) (clock() - m_computeTimer)));
+	m_log.write(" ms");
+	m_log.unlockMutex();
+
+	startColouring();
+}
+
+// Picks an iteration limit for a view from a sparse grid of samples.
+// The limit starts at a floor that grows with zoom depth and doubles,
+// carrying on from where each grid point stopped, until a doubling lets
+// fewer than AUTO_ESCAPE_FRACTION of the grid escape, or the grid has taken
+// AUTO_BUDGET_FRACTION of the frame budget. The limit picked gives the
+// grid's escape times AUTO_HEADROOM over their AUTO_PERCENTILE.
+// Each doubling is iterated by the workers, a band of grid rows per slice.
+// Grid points in the main bulbs never escape, so they are not iterated.
+int MandelbrotViewer::chooseIterations(const View& view)
+{
+	const int sampleCount = AUTO_GRID_X * AUTO_GRID_Y;
+	const clock_t startTime = clock();
+
+	const double depth = std::max(0.0, log2(AUTO_REFERENCE_WIDTH / (view.right - view.left)));
+	const int floorIterations = std::min(AUTO_MIN_ITERATIONS + (int) (AUTO_ITERATIONS_PER_OCTAVE * depth), 
+		AUTO_MAX_ITERATIONS);
+
+	m_probePoints.clear();
+	m_probeZ.assign(sampleCount, std::complex<double>(0.0, 0.0));
+	m_probeIterations.assign(sampleCount, 0);
+	m_probeActive.assign(sampleCount, 1);
+
+	for (int gridY = 0; gridY < AUTO_GRID_Y; ++gridY)
+	{
+		for (int gridX = 0; gridX < AUTO_GRID_X; ++gridX)
+		{
+			std::complex<double> c(view.left + (gridX + 0.5) * (view.right - view.left) / AUTO_GRID_X,
+				view.top + (gridY + 0.5) * (view.bottom - view.top) / AUTO_GRID_Y);
+
+			m_probeActive[m_probePoints.size()] = !Kernel::isInMainBulbs(c);
+			m_probePoints.push_back(c);
+		}
+	}
+
+	m_probeLimit = floorIterations;
+	bool raised = false;
+	bool outOfBudget = false;
+
+	while (true)
+	{
+		m_probeEscaped = 0;
+		startComputeThreads(&MandelbrotViewer::probeSlice);
+		joinComputeThreads();
+
+		if ((raised && m_probeEscaped < AUTO_ESCAPE_FRACTION * sampleCount) || m_probeLimit >= AUTO_MAX_ITERATIONS)
+			break;
+
+		if (clock() - startTime >= AUTO_BUDGET_FRACTION * m_frameBudget)
+		{
+			outOfBudget = true;
+			break;
+		}
+
+		m_probeLimit = std::min(m_probeLimit * 2, AUTO_MAX_ITERATIONS);
+		raised = true;
+	}
+
+	const int limit = m_probeLimit;
+	std::vector<int> escapeTimes;
+
+	for (int i = 0; i < sampleCount; ++i)
+	{
+		if (m_probeIterations[i] > 0 && m_probeIterations[i] < limit)
+			escapeTimes.push_back(m_probeIterations[i]);
+	}
+
+	int chosen = floorIterations;
+
+	if (!escapeTimes.empty())
+	{
+		std::sort(escapeTimes.begin(), escapeTimes.end());
+
+		const int percentile = escapeTimes[(int) (AUTO_PERCENTILE * (escapeTimes.size() - 1))];
+		chosen = std::max(chosen, std::min((int) (percentile * AUTO_HEADROOM), limit));
+	}
+
+	// Round up to the step the + and - keys use
+	chosen = (chosen + 7) / 8 * 8;
+
+	if (m_autoIterationCount > 0 && 
+		fabs((double) (chosen - m_autoIterationCount)) <= AUTO_HYSTERESIS * m_autoIterationCount)
+	{
+		chosen = m_autoIterationCount;
+	}
+
+	m_autoIterationCount = chosen;
+
+	m_log.lockMutex();
+	m_log.write("\nAuto iterations set to ");
+	m_log.write(Helpers::toString(chosen));
+	m_log.write(", grid iterated to ");
+	m_log.write(Helpers::toString(limit));
+	m_log.write(outOfBudget ? " before running out of budget" : "");
+	m_log.write(" in ");
+	m_log.write(Helpers::toString((int) (clock() - startTime)));
+	m_log.write(" ms");
+	m_log.unlockMutex();
+
+	return chosen;
+}
+
+// Iterates a slice's band of the auto-iteration grid up to the current
+// limit, counting the points that escape.
+void MandelbrotViewer::probeSlice(int sliceIdX, int sliceIdY)
+{
+	const int sliceCount = THREAD_COUNT_X * THREAD_COUNT_Y;
+	const int slice = sliceIdY * THREAD_COUNT_X + sliceIdX;
+	const int low = slice * AUTO_GRID_Y / sliceCount * AUTO_GRID_X;
+	const int high = (slice + 1) * AUTO_GRID_Y / sliceCount * AUTO_GRID_X;
+
+	int escaped = 0;
+
+	for (int i = low; i < high; ++i)
+	{
+		if (!m_probeActive[i])
+			continue;
+
+		m_probeIterations[i] = Kernel::escapeTime(m_probePoints[i], m_probeIterations[i], m_probeLimit, m_probeZ[i]);
+
+		if (m_probeIterations[i] < m_probeLimit)
+		{
+			m_probeActive[i] = 0;
+			++escaped;
+		}
+	}
+
+	m_probeEscaped += escaped;
+}
+
+// Advances speculative rendering while the viewer is idle.
+// The views predicted are the current one moved on by one, two, up to
+// SPECULATION_DEPTH repeats of the last navigation step. Each is refined
+// level by level into the view cache, at low thread priority.
+void MandelbrotViewer::speculate()
+{
+	if (m_speculating)
+	{
+		if (!m_pool.waitFor(m_sliceGroups[WorkerPool::BATCH], 0))
+			return;
+
+		m_speculationTime += (int) (clock() - m_speculationTimer);
+
+		if (m_speculationInterrupt)
+		{
+			m_speculating = false;
+			return;
+		}
+
+		m_speculativeEntry->data->pack(m_speculativeData);
+		m_speculativeEntry->refinementStep = m_speculationStep;
+
+		if (m_speculationStep > 1)
+		{
+			m_speculationStep /= 2;
+			m_speculationTimer = clock();
+			startComputeThreads(&MandelbrotViewer::computeSpeculativeSlice, WorkerPool::BATCH);
+			return;
+		}
+
+		m_speculating = false;
+
+		m_log.lockMutex();
+		m_log.write("\nSpeculative render complete");
+		m_log.unlockMutex();
+
+		logSpeculationStats();
+	}
+
+	View step;
+
+	m_navigationMutex.lock();
+	bool recent = m_hasNavigationStep && clock() - m_lastNavigationTime < SPECULATION_WINDOW;
+	step = m_navigationStep;
+	m_navigationMutex.unlock();
+
+	if (!recent)
+		return;
+
+	for (int depth = 1; depth <= SPECULATION_DEPTH; ++depth)
+	{
+		View predicted = offsetView(m_frameView, step, depth);
+
+		if (predicted.maxIterations < 1)
+			return;
+
+		ViewCache::Entry* entry = m_viewCache.find(predicted);
+
+		if (entry != nullptr && entry->refinementStep == 1)
+			continue;
+
+		// Resume a partly refined view, or start a new one
+		if (entry == nullptr)
+		{
+			entry = m_viewCache.acquire(predicted);
+			m_speculationStep = COARSEST_REFINEMENT;
+		}
+		else
+		{
+			entry->data->unpack(m_speculativeData);
+			m_speculationStep = entry->refinementStep / 2;
+		}
+
+		m_speculativeEntry = entry;
+		m_speculativeView = predicted;
+		m_speculationInterrupt = false;
+		m_speculating = true;
+		m_speculationTimer = clock();
+		startComputeThreads(&MandelbrotViewer::computeSpeculativeSlice, WorkerPool::BATCH);
+
+		return;
+	}
+}
+
+// Preempts any speculative work, waiting for the workers to drop it.
+// The cache entry keeps the last level that was completed.
+void MandelbrotViewer::stopSpeculation()
+{
+	if (!m_speculating)
+		return;
+
+	m_speculationInterrupt = true;
+	joinComputeThreads(WorkerPool::BATCH);
+	m_speculationTime += (int) (clock() - m_speculationTimer);
+	m_speculating = false;
+}
+
+void MandelbrotViewer::logSpeculationStats()
+{
+	m_log.lockMutex();
+	m_log.write("\nSpeculation: ");
+	m_log.write(Helpers::toString(m_viewCache.getRenderCount()));
+	m_log.write(" views rendered, ");
+	m_log.write(Helpers::toString(m_viewCache.getHitCount()));
+	m_log.write(" hits, ");
+	m_log.write(Helpers::toString(m_viewCache.getWastedCount()));
+	m_log.write(" wasted, ");
+	m_log.write(Helpers::toString(m_speculationTime));
+	m_log.write(" ms spent, ");
+	m_log.write(Helpers::toString((int) (m_viewCache.getStoredBytes() / 1024)));
+	m_log.write(" KB cached");
+	m_log.unlockMutex();
+}
+
+// Returns the view as it currently stands after input.
+View MandelbrotViewer::getCurrentView()
+{
+	View view;
+	view.left = m_leftSetValue;
+	view.right = m_rightSetValue;
+	view.top = m_topSetValue;
+	view.bottom = m_bottomSetValue;
+	view.maxIterations = m_maxIterations;
+
+	return view;
+}
+
+
+// Returns a pointer to the renderer.
+Renderer* MandelbrotViewer::getRenderer()
+{
+	return &m_renderer;
+}
+
+
+WorkerPool* MandelbrotViewer::getWorkerPool()
+{
+	return &m_pool;
+}
+
+
+// Starts the worker pool, using at most maxNodes NUMA nodes (0 for all of them).
+void MandelbrotViewer::startWorkers(int maxNodes)
+{
+	WorkerPool::Config config;
+	config.pinThreads = PIN_WORKERS;
+	config.maxNodes = maxNodes;
+	config.workersPerNode = WORKERS_PER_NODE;
+
+	m_pool.start(config);
+
+	m_log.lockMutex();
+	m_log.write("\nWorker pool started with ");
+	m_log.write(Helpers::toString(m_pool.getWorkerCount()));
+	m_log.write(" workers over ");
+	m_log.write(Helpers::toString(m_pool.getNodeCount()));
+	m_log.write(m_pool.isPinned() ? " pinned" : " unpinned");
+	m_log.write(" NUMA nodes");
+	m_log.unlockMutex();
+}
+
+// Queues the given pass over every slice on the worker pool.
+// Each slice is queued on the node that owns its tiles.
+void MandelbrotViewer::startComputeThreads(void (MandelbrotViewer::*slice)(int, int))
+{
+	startComputeThreads(slice, WorkerPool::INTERACTIVE);
+}
+
+// As above, in a priority class. Work that can wait, like speculation,
+// is queued as BATCH, so it only runs on workers the frame leaves idle.
+void MandelbrotViewer::startComputeThreads(void (MandelbrotViewer::*slice)(int, int), WorkerPool::Priority priority)
+{
+	if (THREAD_COUNT_X == 0 || THREAD_COUNT_Y == 0)
+	{
+		m_log.write("\nThread bounds invalid, stopping execution");
+		setQuitting(true);
+		return;
+	}
+
+	// Queue the slices in the same order as the tiles within them,
+	// so that a spiral render starts from the middle slice.
+	std::vector<TileOrder::Tile> slices = TileOrder::order(m_tileOrdering, 0, 0, THREAD_COUNT_X, THREAD_COUNT_Y,
+		THREAD_COUNT_X / 2, THREAD_COUNT_Y / 2);
+
+	for (std::vector<TileOrder::Tile>::iterator iter = slices.begin(); iter != slices.end(); ++iter)
+		m_pool.submit(getSliceNode(iter->x, iter->y), priority, m_sliceGroups[priority],
+			std::bind(slice, this, iter->x, iter->y));
+}
+
+// Waits for every queued interactive slice to finish.
+void MandelbrotViewer::joinComputeThreads()
+{
+	joinComputeThreads(WorkerPool::INTERACTIVE);
+}
+
+void MandelbrotViewer::joinComputeThreads(WorkerPool::Priority priority)
+{
+	m_pool.wait(m_sliceGroups[priority]);
+}
+
+// Logs how long tasks of each class waited for a worker since the last frame.
+void MandelbrotViewer::logQueueLatency()
+{
+	static const char* CLASS_NAMES[WorkerPool::PRIORITY_COUNT] = { "interactive", "batch" };
+
+	m_log.lockMutex();
+	m_log.write("\nQueue latency:");
+
+	for (int priority = 0; priority < WorkerPool::PRIORITY_COUNT; ++priority)
+	{
+		const WorkerPool::QueueLatency latency = m_pool.getQueueLatency((WorkerPool::Priority) priority);
+
+		m_log.write(priority == 0 ? " " : ", ");
+		m_log.write(CLASS_NAMES[priority]);
+		m_log.write(" ");
+		m_log.write(Helpers::toString(latency.averageMilliseconds));
+		m_log.write(" ms average, ");
+		m_log.write(Helpers::toString(latency.worstMilliseconds));
+		m_log.write(" ms worst over ");
+		m_log.write(Helpers::toString(latency.tasks));
+		m_log.write(" tasks");
+	}
+
+	m_log.unlockMutex();
+
+	m_pool.resetQueueLatency();
+}
+
+// Renders the benchmark view on one NUMA node, then two, and so on,
+// logging the time taken and the speedup over a single node.
+// The pool is restarted with the configured topology afterwards.
+void MandelbrotViewer::runScalingBenchmark()
+{
+	const int nodeCount = m_pool.getNodeCount();
+	int singleNodeTime = 0;
+
+	for (int nodes = 1; nodes <= nodeCount; ++nodes)
+	{
+		m_pool.stop();
+		startWorkers(nodes);
+		m_pool.resetStealCount();
+
+		m_computeThreadInterrupt = false;
+		m_iterationData.fill(-1.0f);
+		m_refinementCoarsest = 1;
+		m_refinementStep = 1;
+
+		clock_t startTime = clock();
+		startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+		joinComputeThreads();
+		int time = (int) (clock() - startTime);
+
+		if (nodes == 1)
+			singleNodeTime = time;
+
+		m_log.lockMutex();
+		m_log.write("\nScaling benchmark: ");
+		m_log.write(Helpers::toString(nodes));
+		m_log.write(" node(s), ");
+		m_log.write(Helpers::toString(m_pool.getWorkerCount()));
+		m_log.write(" workers, ");
+		m_log.write(Helpers::toString(time));
+		m_log.write(" ms, ");
+		m_log.write(Helpers::toString(m_pool.getStealCount()));
+		m_log.write(" cross-node steals, speedup ");
+		m_log.write(Helpers::toString(time > 0 ? (float) singleNodeTime / (float) time : 1.0f));
+		m_log.unlockMutex();
+	}
+
+	m_pool.stop();
+	startWorkers(NUMA_NODE_LIMIT);
+}
+
+// Renders the benchmark view with each tile ordering, logging the total
+// time and the time until the middle quarter of the frame was complete.
+void MandelbrotViewer::runOrderingBenchmark()
+{
+	const TileOrder::Ordering interactiveOrdering = m_tileOrdering;
+
+	for (int i = 0; i < TileOrder::ORDERING_COUNT; ++i)
+	{
+		m_tileOrdering = (TileOrder::Ordering) i;
+		m_computeThreadInterrupt = false;
+		m_iterationData.fill(-1.0f);
+		m_refinementCoarsest = 1;
+		m_refinementStep = 1;
+		resetCentreTracking();
+
+		clock_t startTime = clock();
+		m_centreCompleteTime = startTime;
+		startComputeThreads(&MandelbrotViewer::computeMandelbrotSet);
+		joinComputeThreads();
+		clock_t endTime = clock();
+
+		m_log.lockMutex();
+		m_log.write("\nOrdering benchmark: ");
+		m_log.write(TileOrder::getName(m_tileOrdering));
+		m_log.write(", ");
+		m_log.write(Helpers::toString((int) (endTime - startTime)));
+		m_log.write(" ms total, centre complete after ");
+		m_log.write(Helpers::toString((int) (m_centreCompleteTime - startTime)));
+		m_log.write(" ms");
+		m_log.unlockMutex();
+	}
+
+	m_tileOrdering = interactiveOrdering;
+}
+
+// Checks the fixed-point kernel against the double one over the whole set,
+// logging how far their escape times differ and how long each kernel took.
+// If they differ by more than the kernels' tolerance, the viewer falls back
+// to the double kernel.
+void MandelbrotViewer::runFixedPointCheck()
+{
+	const Kernel::FixedPointComparison comparison = Kernel::compareFixedPoint(-2.0, 1.0, 1.125, -1.125,
+		FIXED_CHECK_WIDTH, FIXED_CHECK_HEIGHT, FIXED_CHECK_ITERATIONS);
+	const bool passed = Kernel::isWithinTolerance(comparison);
+
+	if (!passed)
+		m_fixedPoint = false;
+
+	m_log.lockMutex();
+	m_log.write(passed ? "\nFixed-point check passed: " : "\nFixed-point check FAILED, using the double kernel: ");
+	m_log.write(Helpers::toString(comparison.exact));
+	m_log.write(" of ");
+	m_log.write(Helpers::toString(comparison.points));
+	m_log.write(" escape times match the double kernel, ");
+	m_log.write(Helpers::toString(comparison.offByOne));
+	m_log.write(" are one iteration off and ");
+	m_log.write(Helpers::toString(comparison.offByMore));
+	m_log.write(" more, by up to ");
+	m_log.write(Helpers::toString(comparison.worstDifference));
+	m_log.write(", fixed ");
+	m_log.write(Helpers::toString((int) comparison.fixedMilliseconds));
+	m_log.write(" ms, double ");
+	m_log.write(Helpers::toString((int) comparison.doubleMilliseconds));
+	m_log.write(" ms");
+	m_log.unlockMutex();
+}
+
+void MandelbrotViewer::update()
+{
+	while (!m_quitting)
+	{
+		if (m_updateThreadInterrupt)
+			return;
+
+		// Get the current clock time.
+		clock_t time = clock();
+
+		// Only update the MandelbrotViewer logic every UPDATE_DELAY.
+		if (time - m_updateTimer > UPDATE_DELAY)
+		{
+			// Feed in the trace's events as they fall due, in place of live input
+			if (m_replaying)
+			{
+				const InputEvent* event;
+
+				while ((event = m_trace.next((int) (time - m_replayStart))) != nullptr)
+					m_inputMgr.onWinEvent(event->message, event->wParam, event->lParam);
+
+				if (m_trace.isFinished())
+					m_replayFinished = true;
+			}
+
+			const View previousView = getCurrentView();
+
+			// This stops the image skewing as the view is zoomed in/out.
+			// It is determined by abs(top) + abs(bottom) / abs(left) + abs(right).
+			const double magicRatio = 0.75;
+
+			if (m_inputMgr.isKeyDown(Keys::UP_ARROW))
+			{
+				if(m_rightSetValue - m_leftSetValue < m_zoomFactor * 5)
+				{
+					m_zoomFactor *= 0.1;
+				}
+
+				m_topSetValue -= m_zoomFactor * magicRatio;
+				m_leftSetValue += m_zoomFactor;
+				m_bottomSetValue += m_zoomFactor * magicRatio;
+				m_rightSetValue -= m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::DOWN_ARROW))
+			{
+				if(m_rightSetValue - m_leftSetValue > m_zoomFactor * 50)
+				{
+					m_zoomFactor *= 10;
+				}
+
+				m_topSetValue += m_zoomFactor * magicRatio;
+				m_leftSetValue -= m_zoomFactor;
+				m_bottomSetValue -= m_zoomFactor * magicRatio;
+				m_rightSetValue += m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			// Zoom about the point under the cursor, so that it stays put on screen
+			const int wheelDelta = m_inputMgr.takeMouseWheelDelta();
+
+			if (wheelDelta != 0)
+			{
+				const double scale = pow(WHEEL_ZOOM_PER_NOTCH, (double) wheelDelta / (double) WHEEL_DELTA);
+				const double anchorX = m_leftSetValue + (m_rightSetValue - m_leftSetValue) *
+					m_inputMgr.getMouseX() / m_renderer.getFrameWidth();
+				const double anchorY = m_topSetValue + (m_bottomSetValue - m_topSetValue) *
+					m_inputMgr.getMouseY() / m_renderer.getFrameHeight();
+
+				m_leftSetValue = anchorX + (m_leftSetValue - anchorX) * scale;
+				m_rightSetValue = anchorX + (m_rightSetValue - anchorX) * scale;
+				m_topSetValue = anchorY + (m_topSetValue - anchorY) * scale;
+				m_bottomSetValue = anchorY + (m_bottomSetValue - anchorY) * scale;
+				m_zoomFactor *= scale;
+				m_needRedraw = true;
+			}
+
+			// The frame is saved by run() once its buffer is consistent
+			if (m_inputMgr.isKeyDownOnce(Keys::SPACEBAR))
+				m_needSnapshot = true;
+
+
+			if (m_inputMgr.isKeyDown(Keys::W))
+			{
+				m_topSetValue += m_zoomFactor;
+				m_bottomSetValue += m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::A))
+			{
+				m_leftSetValue -= m_zoomFactor;
+				m_rightSetValue -= m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::S))
+			{
+				m_topSetValue -= m_zoomFactor;
+				m_bottomSetValue -= m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::D))
+			{
+				m_leftSetValue += m_zoomFactor;
+				m_rightSetValue += m_zoomFactor;
+				m_needRedraw = true;
+			}
+
+			// Cycling the tile ordering takes effect from the next render
+			if (m_inputMgr.isKeyDownOnce(Keys::O))
+			{
+				m_tileOrdering = (TileOrder::Ordering) ((m_tileOrdering + 1) % TileOrder::ORDERING_COUNT);
+
+				m_log.lockMutex();
+				m_log.write("\nTile ordering set to ");
+				m_log.write(TileOrder::getName(m_tileOrdering));
+				m_log.unlockMutex();
+			}
+
+			// Cycling the render mode needs a fresh frame
+			if (m_inputMgr.isKeyDownOnce(Keys::B))
+			{
+				m_renderMode = (RenderMode) ((m_renderMode + 1) % RENDER_MODE_COUNT);
+				m_needRedraw = true;
+
+				m_log.lockMutex();
+				m_log.write("\nRender mode set to ");
+				m_log.write(RENDER_MODE_NAMES[m_renderMode]);
+				m_log.unlockMutex();
+			}
+
+			// Cycling the palette only recolours the stored escape times
+			if (m_inputMgr.isKeyDownOnce(Keys::P))
+			{
+				m_paletteIndex = (m_paletteIndex + 1) % (int) m_palettes.size();
+				m_needRecolour = true;
+			}
+
+			if (m_inputMgr.isKeyDownOnce(Keys::I))
+			{
+				m_autoIterations = !m_autoIterations;
+				m_needRedraw = true;
+			}
+
+			// Adjusting the limit by hand carries on from the automatic one
+			if ((m_inputMgr.isKeyDown(Keys::ADD) || m_inputMgr.isKeyDown(Keys::SUBTRACT)) &&
+				m_autoIterations && m_autoIterationCount > 0)
+			{
+				m_autoIterations = false;
+				m_maxIterations = m_autoIterationCount;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::ADD))
+			{
+				m_maxIterations = std::min(m_maxIterations + ITERATION_STEP, MAX_ITERATIONS);
+				m_needRedraw = true;
+			}
+
+			if (m_inputMgr.isKeyDown(Keys::SUBTRACT))
+			{
+				m_maxIterations = std::max(m_maxIterations - ITERATION_STEP, MIN_ITERATIONS);
+				m_needRedraw = true;
+			}
+
+			// Remember the last navigation step, which speculation repeats
+			const View currentView = getCurrentView();
+
+			if (!(currentView == previousView))
+			{
+				m_navigationMutex.lock();
+				m_navigationStep = viewDifference(previousView, currentView);
+				m_lastNavigationTime = time;
+				m_hasNavigationStep = true;
+				m_navigationMutex.unlock();
+			}
+
+			if (m_needRedraw)
+			{
+				m_speculationInterrupt = true;
+
+				// Latency is measured from the first tick whose input needs a redraw
+				m_navigationMutex.lock();
+
+				if (!m_inputPending)
+				{
+					m_inputPending = true;
+					m_inputTime = time;
+				}
+
+				m_navigationMutex.unlock();
+			}
+
+			// Generation is only superseded by run(), once the frame's budget is spent.
+			// Anti-aliasing starts from a complete frame, so it can stop straight away.
+			if (m_needRedraw && m_state == ANTIALIASING_STATE)
+				m_computeThreadInterrupt = true;
+
+			m_updateTimer = time;
+		}
+	}
+}
+
+// Works out the pixel bounds of a slice of the frame.
+// Slices are made of whole tiles, so no two threads ever write to the same cache line.
+void MandelbrotViewer::computeSliceBounds(int sliceIdX, int sliceIdY, int& lowBoundX, int& lowBoundY,
+										  int& highBoundX, int& highBoundY)
+{
+	const int width = m_renderer.getFrameWidth();
+	const int height = m_renderer.getFrameHeight();
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	const double dSliceIdX = (double) sliceIdX;
+	const double dSliceIdY = (double) sliceIdY;
+
+	double sliceFactorX = (double) m_iterationData.getTilesX() / (double) THREAD_COUNT_X;
+	double sliceFactorY = (double) m_iterationData.getTilesY() / (double) THREAD_COUNT_Y;
+
+	lowBoundX = std::min((int) ceil(dSliceIdX * sliceFactorX) * tileSize, width);
+	lowBoundY = std::min((int) ceil(dSliceIdY * sliceFactorY) * tileSize, height);
+	highBoundX = std::min((int) ceil((dSliceIdX + 1.0) * sliceFactorX) * tileSize, width);
+	highBoundY = std::min((int) ceil((dSliceIdY + 1.0) * sliceFactorY) * tileSize, height);
+}
+
+// Works out the tile bounds of a slice of the frame.
+void MandelbrotViewer::computeSliceTiles(int sliceIdX, int sliceIdY, int& lowTileX, int& lowTileY,
+										 int& highTileX, int& highTileY)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	int lowBoundX, lowBoundY, highBoundX, highBoundY;
+	computeSliceBounds(sliceIdX, sliceIdY, lowBoundX, lowBoundY, highBoundX, highBoundY);
+
+	lowTileX = lowBoundX / tileSize;
+	lowTileY = lowBoundY / tileSize;
+	highTileX = (highBoundX + tileSize - 1) / tileSize;
+	highTileY = (highBoundY + tileSize - 1) / tileSize;
+}
+
+// Returns the slice's tiles in the order set by m_tileOrdering.
+// Spirals are centred on the middle of the frame rather than the slice,
+// so that every slice works towards the frame's edges.
+std::vector<TileOrder::Tile> MandelbrotViewer::orderSliceTiles(int sliceIdX, int sliceIdY)
+{
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	return TileOrder::order(m_tileOrdering, lowTileX, lowTileY, highTileX, highTileY,
+		m_iterationData.getTilesX() / 2, m_iterationData.getTilesY() / 2);
+}
+
+// Returns true if a tile lies in the middle quarter of the frame.
+bool MandelbrotViewer::isCentreTile(int tileX, int tileY)
+{
+	const int tilesX = m_iterationData.getTilesX();
+	const int tilesY = m_iterationData.getTilesY();
+
+	return tileX >= tilesX / 4 && tileX < tilesX - tilesX / 4 &&
+		tileY >= tilesY / 4 && tileY < tilesY - tilesY / 4;
+}
+
+// Starts counting down the centre tiles for a new render.
+void MandelbrotViewer::resetCentreTracking()
+{
+	int centreTiles = 0;
+
+	for (int tileY = 0; tileY < m_iterationData.getTilesY(); ++tileY)
+	{
+		for (int tileX = 0; tileX < m_iterationData.getTilesX(); ++tileX)
+		{
+			if (isCentreTile(tileX, tileY))
+				++centreTiles;
+		}
+	}
+
+	m_centreTilesRemaining = centreTiles;
+}
+
+// Returns the NUMA node that owns a slice.
+// Slices are numbered in memory order and split evenly between the nodes,
+// so each node owns one contiguous run of tiles.
+int MandelbrotViewer::getSliceNode(int sliceIdX, int sliceIdY)
+{
+	const int sliceIndex = sliceIdY * THREAD_COUNT_X + sliceIdX;
+
+	return sliceIndex * m_pool.getNodeCount() / (THREAD_COUNT_X * THREAD_COUNT_Y);
+}
+
+// Marks every pixel of a slice as not yet computed.
+// Also clears the slice's colours and anti-aliasing copy, which the first
+// time round places all of the slice's memory on the node that owns it.
+void MandelbrotViewer::clearSlice(int sliceIdX, int sliceIdY)
+{
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	m_iterationData.fillTiles(lowTileX, lowTileY, highTileX, highTileY, -1.0f);
+	m_aliasedIterationData.fillTiles(lowTileX, lowTileY, highTileX, highTileY, -1.0f);
+	m_colourData.fillTiles(lowTileX, lowTileY, highTileX, highTileY, 0);
+	m_presenter->markDirty(lowTileX, lowTileY, highTileX, highTileY);
+	m_previewMask.fillTiles(lowTileX, lowTileY, highTileX, highTileY, PREVIEW_UNRELIABLE);
+}
+
+// Finds the rows of a view that are mirror images of other rows.
+// Row y samples the imaginary value top + y * spacing, as samples sit on
+// pixel corners, so row y mirrors row sum - y exactly when
+// sum = -2 * top / spacing is whole. Views whose edges are symmetric about
+// the real axis always line up. Rows of the smaller half are mirrored,
+// and the larger half, along with any row on the axis, is computed.
+void MandelbrotViewer::findMirrorRows(const View& view)
+{
+	const int height = m_renderer.getFrameHeight();
+
+	m_mirrorSum = 0;
+	m_mirrorLow = 0;
+	m_mirrorHigh = 0;
+
+	if (!SYMMETRY || view.top <= 0.0 || view.bottom >= 0.0)
+		return;
+
+	const double spacing = (view.bottom - view.top) / (double) height;
+	const double exactSum = -2.0 * view.top / spacing;
+	const int sum = (int) floor(exactSum + 0.5);
+
+	if (fabs(exactSum - (double) sum) > MIRROR_TOLERANCE)
+		return;
+
+	m_mirrorSum = sum;
+
+	if (sum < height - 1)
+	{
+		// The axis is in the top half of the frame
+		m_mirrorLow = 0;
+		m_mirrorHigh = (sum + 1) / 2;
+	}
+	else
+	{
+		m_mirrorLow = sum / 2 + 1;
+		m_mirrorHigh = height;
+	}
+
+	m_log.lockMutex();
+	m_log.write("\nMirroring rows ");
+	m_log.write(Helpers::toString(m_mirrorLow));
+	m_log.write(" to ");
+	m_log.write(Helpers::toString(m_mirrorHigh - 1));
+	m_log.write(" across the real axis");
+	m_log.unlockMutex();
+}
+
+// Copies the slice's mirrored rows from their mirror images.
+// The source rows can belong to any slice, so this runs once the pass
+// that computed them has finished. A row's mirror image is in the same
+// tile column, so whole tile rows are copied at a time.
+void MandelbrotViewer::mirrorSlice(int sliceIdX, int sliceIdY)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	const int lowY = std::max(lowTileY * tileSize, m_mirrorLow);
+	const int highY = std::min(highTileY * tileSize, m_mirrorHigh);
+
+	for (int y = lowY; y < highY; ++y)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			memcpy(&m_iterationData.at(tileX * tileSize, y),
+				&m_iterationData.at(tileX * tileSize, m_mirrorSum - y), tileSize * sizeof(float));
+		}
+	}
+}
+
+// Returns true if escape times in a view are computed with the fixed-point kernel.
+bool MandelbrotViewer::usesFixedPoint(const View& view)
+{
+	const double spacing = std::min(fabs((view.right - view.left) / m_renderer.getFrameWidth()),
+		fabs((view.bottom - view.top) / m_renderer.getFrameHeight()));
+
+	return m_fixedPoint && Kernel::fixedPointCovers(view.left, view.right, view.top, view.bottom, spacing);
+}
+
+// Returns the escape time of the point in the complex plane that
+// corresponds to the (possibly fractional) pixel position x, y in a view.
+// With SMOOTH_COLOURING the escape time is fractional, otherwise whole.
+// Points inside the set return the frame's iteration limit.
+float MandelbrotViewer::computePoint(const View& view, double x, double y)
+{
+	const double width = (double) m_renderer.getFrameWidth();
+	const double height = (double) m_renderer.getFrameHeight();
+
+	// Work out the point in the complex plane that
+	// corresponds to this pixel in the output image.
+	std::complex<double> c(view.left + (x * (view.right - view.left) / width),
+		view.top + (y * (view.bottom - view.top) / height));
+
+	// Single points go through the fixed-point kernel too, with both lanes
+	// taking the same point, so they match the samples computed in pairs
+	if (usesFixedPoint(view))
+	{
+		const double real[2] = { c.real(), c.real() };
+		const double imag[2] = { c.imag(), c.imag() };
+		float values[2];
+
+		Kernel::sampleEscapeTimesFixed(real, imag, view.maxIterations, SMOOTH_COLOURING, values);
+
+		return values[0];
+	}
+
+	return Kernel::sampleEscapeTime(c, view.maxIterations, SMOOTH_COLOURING);
+}
+
+// Returns the escape times for two pixel positions on a row, which the
+// fixed-point kernel computes together.
+void MandelbrotViewer::computePoints(const View& view, const double x[2], double y, float values[2])
+{
+	if (!usesFixedPoint(view))
+	{
+		values[0] = computePoint(view, x[0], y);
+		values[1] = computePoint(view, x[1], y);
+		return;
+	}
+
+	const double width = (double) m_renderer.getFrameWidth();
+	const double height = (double) m_renderer.getFrameHeight();
+
+	const double real[2] = {
+		view.left + (x[0] * (view.right - view.left) / width),
+		view.left + (x[1] * (view.right - view.left) / width)
+	};
+	const double imagValue = view.top + (y * (view.bottom - view.top) / height);
+	const double imag[2] = { imagValue, imagValue };
+
+	Kernel::sampleEscapeTimesFixed(real, imag, view.maxIterations, SMOOTH_COLOURING, values);
+}
+
+// Returns the distance mode's shade for the pixel position x, y in a view.
+float MandelbrotViewer::computeDistance(const View& view, double x, double y)
+{
+	const double pair[2] = { x, x };
+	float shades[2];
+
+	computeDistances(view, pair, y, shades);
+
+	return shades[0];
+}
+
+// Returns the distance mode's shades for two pixel positions on a row,
+// which the distance estimate kernel computes together.
+void MandelbrotViewer::computeDistances(const View& view, const double x[2], double y, float shades[2])
+{
+	const double width = (double) m_renderer.getFrameWidth();
+	const double height = (double) m_renderer.getFrameHeight();
+	const double spacing = (view.right - view.left) / width;
+
+	const double real[2] = {
+		view.left + (x[0] * (view.right - view.left) / width),
+		view.left + (x[1] * (view.right - view.left) / width)
+	};
+	const double imagValue = view.top + (y * (view.bottom - view.top) / height);
+	const double imag[2] = { imagValue, imagValue };
+
+	double distances[2];
+	Kernel::estimateDistances(real, imag, view.maxIterations, distances);
+
+	shades[0] = Kernel::distanceShade(distances[0], spacing, view.maxIterations);
+	shades[1] = Kernel::distanceShade(distances[1], spacing, view.maxIterations);
+}
+
+// Returns the value the frame's mode stores for a pixel position.
+float MandelbrotViewer::samplePoint(const View& view, double x, double y)
+{
+	if (m_frameMode == DISTANCE_MODE)
+		return computeDistance(view, x, y);
+
+	return computePoint(view, x, y);
+}
+
+// Returns the values the frame's mode stores for two pixel positions on a row.
+void MandelbrotViewer::samplePoints(const View& view, const double x[2], double y, float values[2])
+{
+	if (m_frameMode == DISTANCE_MODE)
+		computeDistances(view, x, y, values);
+	else
+		computePoints(view, x, y, values);
+}
+
+// Returns true if the distance estimate proves that every pixel of a tile
+// is further than DISTANCE_SATURATION pixels from the set. A quarter of the
+// estimate at the tile's centre is a lower bound on the distance to the set,
+// and the tile lies within half its diagonal of the centre.
+bool MandelbrotViewer::isTileExterior(const View& view, int tileX, int tileY)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+	const double width = (double) m_renderer.getFrameWidth();
+	const double height = (double) m_renderer.getFrameHeight();
+	const double spacing = std::max(fabs((view.right - view.left) / width), fabs((view.bottom - view.top) / height));
+
+	// Both lanes of the kernel take the same point
+	const double centreX = view.left + (tileX + 0.5) * tileSize * (view.right - view.left) / width;
+	const double centreY = view.top + (tileY + 0.5) * tileSize * (view.bottom - view.top) / height;
+	const double real[2] = { centreX, centreX };
+	const double imag[2] = { centreY, centreY };
+
+	double distances[2];
+	Kernel::estimateDistances(real, imag, view.maxIterations, distances);
+
+	const double halfDiagonal = 0.5 * sqrt(2.0) * tileSize;
+
+	return distances[0] >= 0.0 && 0.25 * distances[0] >= (Kernel::DISTANCE_SATURATION + halfDiagonal) * spacing;
+}
+
+void MandelbrotViewer::computeMandelbrotSet(int sliceIdX, int sliceIdY)
+{
+	clock_t startTime = clock();
+
+	int lowBoundX, lowBoundY, highBoundX, highBoundY;
+	computeSliceBounds(sliceIdX, sliceIdY, lowBoundX, lowBoundY, highBoundX, highBoundY);
+
+	m_log.lockMutex();
+	m_log.write("\nThread ");
+	m_log.write(Helpers::toString(sliceIdX));
+	m_log.write("-");
+	m_log.write(Helpers::toString(sliceIdY));
+	m_log.write(" working from x: ");
+	m_log.write(Helpers::toString(lowBoundX));
+	m_log.write(" to ");
+	m_log.write(Helpers::toString(highBoundX));
+	m_log.write(", y: ");
+	m_log.write(Helpers::toString(lowBoundY));
+	m_log.write(" to ");
+	m_log.write(Helpers::toString(highBoundY));
+	m_log.unlockMutex();
+
+	bool completed;
+
+	if (m_previewPass != 0)
+	{
+		// Recompute the unreliable preview pixels, then the reliable ones
+		completed = refineSlice(sliceIdX, sliceIdY, m_frameView, m_iterationData, 1, true, 
+			&m_computeThreadInterrupt, m_previewPass == 2,
+			&m_previewMask, m_previewPass == 1 ? PREVIEW_UNRELIABLE : PREVIEW_RELIABLE, true);
+	}
+	else
+	{
+		completed = refineSlice(sliceIdX, sliceIdY, m_frameView, m_iterationData, m_refinementStep,
+			m_refinementStep == m_refinementCoarsest, &m_computeThreadInterrupt, true, nullptr, 0, true);
+	}
+
+	if (!completed)
+		return;
+
+	clock_t endTime = clock();
+
+	m_log.lockMutex();
+	m_log.write("\nThread ");
+	m_log.write(Helpers::toString(sliceIdX));
+	m_log.write("-");
+	m_log.write(Helpers::toString(sliceIdY));
+	m_log.write(" finished in ");
+	m_log.write(Helpers::toString((int) (endTime - startTime)));
+	m_log.write(" ms ");
+	m_log.unlockMutex();
+}
+
+// Returns true once the frame on screen is complete, if coarse:
+// either a whole refinement level, a reprojected preview or a batch of orbits.
+bool MandelbrotViewer::hasCompleteFrame()
+{
+	if (isOrbitMode(m_frameMode))
+		return m_orbitBatch > 0;
+
+	return m_previewPass != 0 || m_refinementStep < m_refinementCoarsest;
+}
+
+// Fills a slice with the previous frame's escape times, resampled into the
+// new view. A preview pixel is reliable if it maps inside the previous frame
+// and the 3x3 pixels around its source all share an escape time; the rest
+// are recomputed first.
+void MandelbrotViewer::reprojectSlice(int sliceIdX, int sliceIdY)
+{
+	const int width = m_renderer.getFrameWidth();
+	const int height = m_renderer.getFrameHeight();
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	const View& from = m_previousFrameView;
+	const View& to = m_frameView;
+
+	const double scaleX = (to.right - to.left) / (from.right - from.left);
+	const double scaleY = (to.bottom - to.top) / (from.bottom - from.top);
+	const double offsetX = (to.left - from.left) / (from.right - from.left) * width;
+	const double offsetY = (to.top - from.top) / (from.bottom - from.top) * height;
+
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	int reliablePixels = 0;
+
+	for (int y = lowTileY * tileSize; y < std::min(highTileY * tileSize, height); ++y)
+	{
+		// Samples sit on pixel corners, so the nearest source pixel is found by rounding.
+		const int sourceY = (int) floor(offsetY + y * scaleY + 0.5);
+
+		for (int x = lowTileX * tileSize; x < std::min(highTileX * tileSize, width); ++x)
+		{
+			const int sourceX = (int) floor(offsetX + x * scaleX + 0.5);
+
+			if (sourceX < 0 || sourceX >= width || sourceY < 0 || sourceY >= height)
 			{
-				m_topSetValue -= m_zoomFactor;
-				m_bottomSetValue -= m_zoomFactor;
-				m_needRedraw = true;
+				m_iterationData.at(x, y) = -1.0f;
+				m_previewMask.at(x, y) = PREVIEW_UNRELIABLE;
+				continue;
 			}
 
-			if (m_inputMgr.isKeyDown(Keys::D))
+			const float source = m_aliasedIterationData.at(sourceX, sourceY);
+			bool reliable = source >= 0.0f;
+
+			for (int neighbourY = sourceY - 1; neighbourY <= sourceY + 1 && reliable; ++neighbourY)
 			{
-				m_leftSetValue += m_zoomFactor;
-				m_rightSetValue += m_zoomFactor;
-				m_needRedraw = true;
+				for (int neighbourX = sourceX - 1; neighbourX <= sourceX + 1 && reliable; ++neighbourX)
+				{
+					if (neighbourX < 0 || neighbourX >= width || neighbourY < 0 || neighbourY >= height ||
+						fabs(m_aliasedIterationData.at(neighbourX, neighbourY) - source) >= 1.0f)
+					{
+						reliable = false;
+					}
+				}
 			}
 
-			if (m_inputMgr.isKeyDown(Keys::ADD))
+			m_iterationData.at(x, y) = source;
+			m_previewMask.at(x, y) = reliable ? PREVIEW_RELIABLE : PREVIEW_UNRELIABLE;
+
+			if (reliable)
+				++reliablePixels;
+		}
+	}
+
+	m_reliablePixels += reliablePixels;
+}
+
+// Returns how many points of c's orbit, and of its mirror image, land in
+// the view, or 0 if the orbit is not drawn by the frame's mode: Buddhabrots
+// draw the orbits that escape and anti-Buddhabrots the ones that do not.
+// The orbit is only traced once the escape-time kernel has classified it.
+// If a histogram is given, each point in view adds weight to its pixel.
+// The set is symmetric about the real axis, so the mirror image of every
+// orbit is drawn as well, which halves the samples needed.
+double MandelbrotViewer::traceOrbit(const View& view, std::complex<double> c, TiledBuffer<float>* histogram, float weight)
+{
+	const int width = m_renderer.getFrameWidth();
+	const int height = m_renderer.getFrameHeight();
+	const int maxIterations = view.maxIterations;
+
+	int iterations = maxIterations;
+	std::complex<double> z;
+
+	if (m_frameMode == ANTI_BUDDHABROT_MODE || !Kernel::isInMainBulbs(c))
+		iterations = Kernel::escapeTime(c, maxIterations, z);
+
+	const bool escaped = iterations < maxIterations;
+
+	if (escaped != (m_frameMode == BUDDHABROT_MODE))
+		return 0.0;
+
+	// Samples sit on pixel corners, so the nearest pixel is found by rounding.
+	const double scaleX = (double) width / (view.right - view.left);
+	const double scaleY = (double) height / (view.bottom - view.top);
+
+	int pointsInView = 0;
+	z = std::complex<double>(0.0, 0.0);
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		z = (z * z) + c;
+
+		const int x = (int) floor((z.real() - view.left) * scaleX + 0.5);
+
+		if (x < 0 || x >= width)
+			continue;
+
+		const int y = (int) floor((z.imag() - view.top) * scaleY + 0.5);
+		const int mirrorY = (int) floor((-z.imag() - view.top) * scaleY + 0.5);
+
+		if (y >= 0 && y < height)
+		{
+			++pointsInView;
+
+			if (histogram != nullptr)
+				histogram->at(x, y) += weight;
+		}
+
+		if (mirrorY >= 0 && mirrorY < height)
+		{
+			++pointsInView;
+
+			if (histogram != nullptr)
+				histogram->at(x, mirrorY) += weight;
+		}
+	}
+
+	return (double) pointsInView;
+}
+
+// Traces one batch of orbits into the slice's histogram.
+// Points are chosen by Metropolis-Hastings, so that orbits which cross
+// the view, which are rare once zoomed in, are found cheaply: a proposal is
+// accepted with the ratio of its orbit points in view to the current
+// point's. Proposals are either a small mutation of the current point or a
+// fresh point anywhere in the set's bounding square, both symmetric, and
+// every point is weighted by the inverse of its orbit points in view, so
+// the density is unbiased.
+void MandelbrotViewer::traceOrbits(int sliceIdX, int sliceIdY)
+{
+	const int slice = sliceIdY * THREAD_COUNT_X + sliceIdX;
+	OrbitSampler& sampler = m_orbitSamplers[slice];
+	TiledBuffer<float>& histogram = m_orbitHistograms[slice];
+	const View& view = m_frameView;
+
+	if (m_orbitBatch == 0)
+	{
+		// Also first touches the histogram from the worker that fills it
+		histogram.fill(0.0f);
+		sampler.random.seed(slice + 1);
+		sampler.contribution = 0.0;
+		sampler.repeats = 0;
+	}
+
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::uniform_real_distribution<double> square(-2.0, 2.0);
+	std::normal_distribution<double> mutation(0.0, (view.right - view.left) * ORBIT_MUTATION_SCALE);
+
+	for (int i = 0; i < ORBIT_BATCH_SAMPLES && !m_computeThreadInterrupt; ++i)
+	{
+		std::complex<double> proposal;
+
+		if (sampler.contribution > 0.0 && unit(sampler.random) < ORBIT_MUTATION_CHANCE)
+			proposal = sampler.c + std::complex<double>(mutation(sampler.random), mutation(sampler.random));
+		else
+			proposal = std::complex<double>(square(sampler.random), square(sampler.random));
+
+		const double contribution = traceOrbit(view, proposal, nullptr, 0.0f);
+
+		if (contribution > 0.0 && unit(sampler.random) * sampler.contribution < contribution)
+		{
+			if (sampler.repeats > 0)
+				traceOrbit(view, sampler.c, &histogram, (float) (sampler.repeats / sampler.contribution));
+
+			sampler.c = proposal;
+			sampler.contribution = contribution;
+			sampler.repeats = 1;
+		}
+		else if (sampler.contribution > 0.0)
+		{
+			++sampler.repeats;
+		}
+	}
+
+	// Splat the point held at the end of the batch, so the batch is complete
+	if (sampler.repeats > 0)
+	{
+		traceOrbit(view, sampler.c, &histogram, (float) (sampler.repeats / sampler.contribution));
+		sampler.repeats = 0;
+	}
+}
+
+// Sums every slice's histogram over this slice's tiles, into the orbit
+// density, and finds the slice's highest density. Each slice writes only
+// its own tiles, so the reduction runs in parallel without atomics.
+void MandelbrotViewer::reduceOrbitSlice(int sliceIdX, int sliceIdY)
+{
+	const int tileArea = TiledBuffer<float>::TILE_AREA;
+	const int histogramCount = THREAD_COUNT_X * THREAD_COUNT_Y;
+
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	float maxDensity = 0.0f;
+
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			float* density = m_aliasedIterationData.getTile(tileX, tileY);
+			std::fill(density, density + tileArea, 0.0f);
+
+			for (int i = 0; i < histogramCount; ++i)
 			{
-				m_maxIterations += 8;
-				m_needRedraw = true;
+				const float* histogram = m_orbitHistograms[i].getTile(tileX, tileY);
+
+				for (int j = 0; j < tileArea; ++j)
+					density[j] += histogram[j];
 			}
 
-			if (m_inputMgr.isKeyDown(Keys::SUBTRACT))
+			maxDensity = std::max(maxDensity, *std::max_element(density, density + tileArea));
+		}
+	}
+
+	m_orbitSliceDensity[sliceIdY * THREAD_COUNT_X + sliceIdX] = maxDensity;
+}
+
+// Maps the slice's orbit density onto escape times, so the palettes can
+// colour it. The square root brings out faint orbits, and pixels no orbit
+// reached take the iteration limit, which the palettes keep for the set.
+void MandelbrotViewer::mapOrbitSlice(int sliceIdX, int sliceIdY)
+{
+	const int tileArea = TiledBuffer<float>::TILE_AREA;
+	const float limit = (float) m_frameView.maxIterations;
+	const float highest = limit - 1.0f / (float) Palette::LUT_SCALE;
+	const float scale = m_orbitMaxDensity > 0.0f ? 1.0f / m_orbitMaxDensity : 0.0f;
+
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
+
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			const float* density = m_aliasedIterationData.getTile(tileX, tileY);
+			float* iterations = m_iterationData.getTile(tileX, tileY);
+
+			for (int i = 0; i < tileArea; ++i)
+				iterations[i] = density[i] > 0.0f ? highest * sqrt(density[i] * scale) : limit;
+		}
+	}
+}
+
+// Computes one refinement level of a speculative view, at low priority.
+void MandelbrotViewer::computeSpeculativeSlice(int sliceIdX, int sliceIdY)
+{
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+
+	refineSlice(sliceIdX, sliceIdY, m_speculativeView, m_speculativeData, m_speculationStep,
+		m_speculationStep == COARSEST_REFINEMENT, &m_speculationInterrupt, false, nullptr, 0, false);
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+}
+
+// Computes one refinement level of a slice of a view into a buffer.
+// Each level samples every step'th pixel and fills the step x step block
+// below and to the right of it. Unless this is the first level, samples
+// already taken by the previous, twice as coarse, level are skipped.
+// Blocks never cross a tile, because the tile size is a multiple of every step.
+// If a mask is given, only the pixels where it equals maskValue are computed.
+// With skipMirrored, samples whose whole block lies in the frame's mirrored
+// rows are left for mirrorSlice(). In the distance mode, and with the
+// fixed-point kernel, pairs of samples on a row are computed together. In the
+// distance mode, unless a mask is given, tiles proven to be far outside the
+// set are filled on the first level and skipped after it.
+// Returns false if interrupted.
+bool MandelbrotViewer::refineSlice(int sliceIdX, int sliceIdY, const View& view, TiledBuffer<float>& data,
+								   int step, bool firstLevel, const bool* interrupt, bool trackCentre,
+								   const TiledBuffer<unsigned int>* mask, unsigned int maskValue, bool skipMirrored)
+{
+	const int width = m_renderer.getFrameWidth();
+	const int height = m_renderer.getFrameHeight();
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	const bool distance = m_frameMode == DISTANCE_MODE;
+	const bool paired = distance || usesFixedPoint(view);
+
+	std::vector<TileOrder::Tile> tiles = orderSliceTiles(sliceIdX, sliceIdY);
+
+	for (std::vector<TileOrder::Tile>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+	{
+		const int tileHighX = std::min((tile->x + 1) * tileSize, width);
+		const int tileHighY = std::min((tile->y + 1) * tileSize, height);
+
+		// Fills the step x step block below and to the right of a sample
+		auto fillBlock = [&](int x, int y, float value)
+		{
+			for (int blockY = y; blockY < y + step && blockY < tileHighY; ++blockY)
 			{
-				m_maxIterations -= 8;
-				m_needRedraw = true;
+				for (int blockX = x; blockX < x + step && blockX < tileHighX; ++blockX)
+					data.at(blockX, blockY) = value;
 			}
+		};
 
-			if (m_needRedraw && m_state == GENERATING_STATE)
-				m_computeThreadInterrupt = true;
+		if (distance && mask == nullptr)
+		{
+			unsigned char& exterior = m_exteriorTiles[tile->y * data.getTilesX() + tile->x];
 
-			m_updateTimer = time;
+			if (firstLevel)
+			{
+				exterior = isTileExterior(view, tile->x, tile->y) ? 1 : 0;
+
+				if (exterior)
+				{
+					const float farthest = Kernel::distanceShade(Kernel::DISTANCE_SATURATION, 1.0, view.maxIterations);
+					data.fillTiles(tile->x, tile->y, tile->x + 1, tile->y + 1, farthest);
+					++m_exteriorTileCount;
+				}
+			}
+
+			if (exterior)
+				continue;
+		}
+
+		for (int y = tile->y * tileSize; y < tileHighY; y += step)
+		{
+			if (skipMirrored && y >= m_mirrorLow && std::min(y + step, tileHighY) <= m_mirrorHigh)
+				continue;
+
+			int pending = -1;
+
+			for (int x = tile->x * tileSize; x < tileHighX; x += step)
+			{
+				if (*interrupt)
+					return false;
+
+				if (!firstLevel && x % (step * 2) == 0 && y % (step * 2) == 0)
+					continue;
+
+				if (mask != nullptr && mask->at(x, y) != maskValue)
+					continue;
+
+				if (!paired)
+				{
+					fillBlock(x, y, computePoint(view, (double) x, (double) y));
+					continue;
+				}
+
+				// Hold the first sample of each pair until its partner is found
+				if (pending < 0)
+				{
+					pending = x;
+					continue;
+				}
+
+				const double pair[2] = { (double) pending, (double) x };
+				float values[2];
+				samplePoints(view, pair, (double) y, values);
+
+				fillBlock(pending, y, values[0]);
+				fillBlock(x, y, values[1]);
+				pending = -1;
+			}
+
+			if (pending >= 0)
+				fillBlock(pending, y, samplePoint(view, (double) pending, (double) y));
 		}
+
+		// Record when the middle of the frame has been fully computed
+		if (trackCentre && step == 1 && isCentreTile(tile->x, tile->y) && --m_centreTilesRemaining == 0)
+			m_centreCompleteTime = clock();
 	}
+
+	return true;
 }
 
-void MandelbrotViewer::computeMandelbrotSet(int sliceIdX, int sliceIdY)
+// Adaptive anti-aliasing pass, run over a slice after the 1-spp pass.
+void MandelbrotViewer::computeAntialiasing(int sliceIdX, int sliceIdY)
 {
-	clock_t startTime = clock();
+	const int width = m_renderer.getFrameWidth();
+	const int height = m_renderer.getFrameHeight();
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	std::vector<TileOrder::Tile> tiles = orderSliceTiles(sliceIdX, sliceIdY);
+
+	int extraSamples = 0;
+	int refinedPixels = 0;
+	int distanceRejects = 0;
+
+	for (std::vector<TileOrder::Tile>::iterator tile = tiles.begin(); 
+		tile != tiles.end() && !m_computeThreadInterrupt; ++tile)
+	{
+		const int tileHighX = std::min((tile->x + 1) * tileSize, width);
+		const int tileHighY = std::min((tile->y + 1) * tileSize, height);
+
+		// Mirrored rows are refined too. A pixel's jittered samples cover the
+		// rows below its corner, whose mirror images are the rows above the
+		// corner it is copied from, so its refined value is not a copy.
+		for (int y = tile->y * tileSize; y < tileHighY; ++y)
+		{
+			for (int x = tile->x * tileSize; x < tileHighX; ++x)
+			{
+				int samples = antialiasPixel(x, y);
+
+				if (samples > 0)
+				{
+					extraSamples += samples;
+					++refinedPixels;
+				}
+				else if (samples < 0)
+				{
+					++distanceRejects;
+				}
+			}
+		}
+	}
+
+	m_aaExtraSamples += extraSamples;
+	m_aaPixels += refinedPixels;
+	m_aaDistanceRejects += distanceRejects;
+}
 
+// Refines one pixel, returning the number of extra samples it took.
+// Pixels whose escape time differs sharply from a neighbour get extra
+// jittered samples, as do escaping pixels the distance estimate cannot
+// prove clear of the set. A refined pixel stops after AA_MIN_SAMPLES if every
+// extra sample agrees with the original, otherwise it goes on to AA_MAX_SAMPLES.
+// The averaged escape time is stored, so refined pixels survive recolouring.
+int MandelbrotViewer::antialiasPixel(int x, int y)
+{
 	const int width = m_renderer.getFrameWidth();
 	const int height = m_renderer.getFrameHeight();
 
-	const double dSliceIdX = (double) sliceIdX;
-	const double dSliceIdY = (double) sliceIdY;
+	// Neighbours are read from the untouched 1-spp copy, so refinement
+	// in other slices cannot change which pixels get refined here.
+	const float centre = m_aliasedIterationData.at(x, y);
+	const float* neighbours[4] = {
+		x > 0 ? &m_aliasedIterationData.at(x - 1, y) : nullptr,
+		x < width - 1 ? &m_aliasedIterationData.at(x + 1, y) : nullptr,
+		y > 0 ? &m_aliasedIterationData.at(x, y - 1) : nullptr,
+		y < height - 1 ? &m_aliasedIterationData.at(x, y + 1) : nullptr
+	};
 
-	double sliceFactorX = (double) width / (double) THREAD_COUNT_X;
-	double sliceFactorY = (double) height / (double) THREAD_COUNT_Y;
+	float gradient = 0.0f;
 
-	const int lowBoundX = (int) ceil(dSliceIdX * sliceFactorX);
-	const int lowBoundY = (int) ceil(dSliceIdY * sliceFactorY);
-	const int highBoundX = (int) ceil((dSliceIdX + 1.0) * sliceFactorX);
-	const int highBoundY = (int) ceil((dSliceIdY + 1.0) * sliceFactorY);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (neighbours[i] == nullptr)
+			continue;
 
-	m_log.lockMutex();
-	m_log.write("\nThread ");
-	m_log.write(Helpers::toString(sliceIdX));
-	m_log.write("-");
-	m_log.write(Helpers::toString(sliceIdY));
-	m_log.write(" working from x: ");
-	m_log.write(Helpers::toString(lowBoundX));
-	m_log.write(" to ");
-	m_log.write(Helpers::toString(highBoundX));
-	m_log.write(", y: ");
-	m_log.write(Helpers::toString(lowBoundY));
-	m_log.write(" to ");
-	m_log.write(Helpers::toString(highBoundY));
-	m_log.unlockMutex();
+		float difference = fabs(centre - *neighbours[i]);
 
-	int highest;
+		if (difference > gradient)
+			gradient = difference;
+	}
 
-	if (width > height)
-		highest = width;
-	else
-		highest = height;
+	// A sharp gradient is always refined. A smooth one can still hide
+	// boundary detail finer than the pixel spacing, such as a filament
+	// passing between samples. A quarter of the distance estimate at the
+	// pixel's centre bounds how close the set comes, so an escaping pixel it
+	// proves clear of the set keeps its one smooth sample, and any other is
+	// refined. Returns -1 for pixels ruled out this way. The estimate says
+	// nothing about points inside the set, which are only refined on a gradient.
+	if (gradient <= (float) AA_THRESHOLD)
+	{
+		const View& view = m_frameView;
+
+		if (!AA_DISTANCE_TEST || !SMOOTH_COLOURING || m_frameMode != ESCAPE_TIME_MODE ||
+			centre < 0.0f || centre >= (float) view.maxIterations)
+		{
+			return 0;
+		}
+
+		const double spacing = std::max(fabs((view.right - view.left) / width), fabs((view.bottom - view.top) / height));
+		const double centreX = view.left + (x + 0.5) * (view.right - view.left) / width;
+		const double centreY = view.top + (y + 0.5) * (view.bottom - view.top) / height;
+		const double real[2] = { centreX, centreX };
+		const double imag[2] = { centreY, centreY };
+
+		double distances[2];
+		Kernel::estimateDistances(real, imag, view.maxIterations, distances);
+
+		if (distances[0] >= 0.0 && 0.25 * distances[0] > 0.5 * sqrt(2.0) * spacing)
+			return -1;
+	}
+
+	float total = centre;
+	int samples = 1;
+	bool agrees = true;
+
+	while (samples < AA_MAX_SAMPLES)
+	{
+		if (samples == AA_MIN_SAMPLES && agrees)
+			break;
+
+		// Jitter the sample inside its stratum of a 4x4 sub-pixel grid.
+		const int stratum = AA_STRATA_ORDER[samples];
+		const double offsetX = ((stratum % 4) + sampleJitter(x, y, samples * 2)) * 0.25;
+		const double offsetY = ((stratum / 4) + sampleJitter(x, y, samples * 2 + 1)) * 0.25;
+
+		float sample = samplePoint(m_frameView, x + offsetX, y + offsetY);
+
+		if (fabs(sample - centre) >= 1.0f)
+			agrees = false;
+
+		total += sample;
+		++samples;
+	}
+
+	m_iterationData.at(x, y) = total / (float) samples;
+
+	return samples - 1;
+}
+
+// Counts the escape times in a slice into that slice's histogram.
+// The per-slice histograms are merged by buildPalette(), so the
+// threads never share a counter.
+void MandelbrotViewer::computeHistogram(int sliceIdX, int sliceIdY)
+{
+	int lowBoundX, lowBoundY, highBoundX, highBoundY;
+	computeSliceBounds(sliceIdX, sliceIdY, lowBoundX, lowBoundY, highBoundX, highBoundY);
+
+	std::vector<unsigned int>& histogram = m_sliceHistograms[sliceIdX * THREAD_COUNT_Y + sliceIdY];
+	const int maxIterations = m_frameView.maxIterations;
+	histogram.assign(maxIterations + 1, 0);
 
 	for (int y = lowBoundY; y < highBoundY; ++y)
 	{
 		for (int x = lowBoundX; x < highBoundX; ++x)
 		{
-			if (m_computeThreadInterrupt)
-				return;
+			int iterations = (int) m_iterationData.at(x, y);
+
+			if (iterations < 0)
+				continue;
+
+			if (iterations > maxIterations)
+				iterations = maxIterations;
+
+			++histogram[iterations];
+		}
+	}
+}
+
+// Rebuilds the selected palette for the current iteration limit,
+// gathering a histogram of the frame first if the palette needs one.
+void MandelbrotViewer::buildPalette()
+{
+	const int paletteIndex = m_paletteIndex;
+	Palette* palette = m_palettes[paletteIndex];
+
+	std::vector<unsigned int> histogram;
+
+	if (palette->needsHistogram())
+	{
+		startComputeThreads(&MandelbrotViewer::computeHistogram);
+		joinComputeThreads();
+
+		// Reduce the per-slice histograms into one.
+		histogram.assign(m_frameView.maxIterations + 1, 0);
+
+		for (std::vector<std::vector<unsigned int> >::iterator iter = m_sliceHistograms.begin();
+			iter != m_sliceHistograms.end(); ++iter)
+		{
+			for (int i = 0; i < (int) iter->size() && i < (int) histogram.size(); ++i)
+				histogram[i] += (*iter)[i];
+		}
+	}
+
+	m_paletteMutex.lock();
+	palette->build(m_frameView.maxIterations, histogram);
+	m_builtPaletteIndex = paletteIndex;
+	m_paletteMutex.unlock();
+}
+
+// Starts the colouring pass, which maps the stored escape times
+// through the palette into the display buffer.
+void MandelbrotViewer::startColouring()
+{
+	m_needRecolour = false;
+	m_colourTimer = clock();
+
+	buildPalette();
+	startComputeThreads(&MandelbrotViewer::colourSlice);
+	m_state = COLOURING_STATE;
+}
 
-			// Work out the point in the complex plane that
-			// corresponds to this pixel in the output image.
-			std::complex<double> c(m_leftSetValue + (x * (m_rightSetValue - m_leftSetValue) / width),
-				m_topSetValue + (y * (m_bottomSetValue - m_topSetValue) / height));
+// Colours a range of tiles from the stored escape times.
+// Four pixels at a time are scaled, clamped and converted to lookup table
+// indices with SSE2, pixels that have not been computed yet are masked to
+// black, and the BGRX results are written with aligned vector stores.
+// Tiles whose colours changed are marked dirty for the next present.
+void MandelbrotViewer::colourTiles(int lowTileX, int lowTileY, int highTileX, int highTileY)
+{
+	const int tileArea = TiledBuffer<float>::TILE_AREA;
+
+	Palette* palette = m_palettes[m_builtPaletteIndex];
+	const unsigned int* lut = palette->getLut();
+	const int lutSize = palette->getLutSize();
 
-			// Start off z at (0, 0).
-			std::complex<double> z(0.0, 0.0);
+	const __m128 scale = _mm_set1_ps((float) Palette::LUT_SCALE);
+	const __m128 lowest = _mm_setzero_ps();
+	const __m128 highestIndex = _mm_set1_ps((float) (lutSize - 1));
+
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			const float* iterations = m_iterationData.getTile(tileX, tileY);
+			unsigned int* colours = m_colourData.getTile(tileX, tileY);
 
-			// Iterate z = z^2 + c until z moves more than 2 units
-			// away from (0, 0), or we've iterated too many times.
-			int iterations = 0;
+			__m128i changed = _mm_setzero_si128();
 
-			while (abs(z) < 2.0 && iterations < m_maxIterations) 
+			for (int i = 0; i < tileArea; i += 4)
 			{
-				z = (z * z) + c;
-				++iterations;
+				__m128 values = _mm_load_ps(&iterations[i]);
+				__m128i computed = _mm_castps_si128(_mm_cmpge_ps(values, lowest));
+
+				values = _mm_min_ps(_mm_max_ps(_mm_mul_ps(values, scale), lowest), highestIndex);
+
+				int indices[4];
+				_mm_storeu_si128((__m128i*) indices, _mm_cvttps_epi32(values));
+
+				__m128i packed = _mm_and_si128(_mm_set_epi32(lut[indices[3]], lut[indices[2]], lut[indices[1]], lut[indices[0]]), computed);
+				changed = _mm_or_si128(changed, _mm_xor_si128(packed, _mm_load_si128((const __m128i*) &colours[i])));
+				_mm_store_si128((__m128i*) &colours[i], packed);
 			}
 
-			m_rawImageData[(x * 3) + ((y * 3) * highest)] = abs(iterations - m_maxIterations);
-			m_rawImageData[(x * 3) + ((y * 3) * highest) + 1] = abs(iterations - m_maxIterations / 2);
-			m_rawImageData[(x * 3) + ((y * 3) * highest) + 2] = abs(iterations - m_maxIterations / 3);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(changed, _mm_setzero_si128())) != 0xFFFF)
+				m_presenter->markDirty(tileX, tileY);
 		}
 	}
+}
 
-	clock_t endTime = clock();
+void MandelbrotViewer::colourSlice(int sliceIdX, int sliceIdY)
+{
+	int lowTileX, lowTileY, highTileX, highTileY;
+	computeSliceTiles(sliceIdX, sliceIdY, lowTileX, lowTileY, highTileX, highTileY);
 
-	m_log.lockMutex();
-	m_log.write("\nThread ");
-	m_log.write(Helpers::toString(sliceIdX));
-	m_log.write("-");
-	m_log.write(Helpers::toString(sliceIdY));
-	m_log.write(" finished in ");
-	m_log.write(Helpers::toString(endTime - startTime));
-	m_log.write(" ms ");
-	m_log.unlockMutex();
+	colourTiles(lowTileX, lowTileY, highTileX, highTileY);
 }
 
 void MandelbrotViewer::render()
@@ -413,15 +2795,21 @@ void MandelbrotViewer::render()
 		// Only update the MandelbrotViewer logic every UPDATE_DELAY.
 		if (time - m_renderTimer > RENDER_DELAY)
 		{
+			// While the set is being computed, preview it with the last built palette.
+			// Once complete, the colouring pass has already filled the display buffer.
+			if (m_state == GENERATING_STATE || m_state == ANTIALIASING_STATE)
+			{
+				m_paletteMutex.lock();
+				colourTiles(0, 0, m_colourData.getTilesX(), m_colourData.getTilesY());
+				m_paletteMutex.unlock();
+			}
+
 			// This really shouldn't be called without pausing all of the computation threads (or having them write to a back buffer)
 			// But corruption isn't really visible in the viewer so it doesn't matter
-			SetDIBitsToDevice(*(m_renderer.getBackHdc()), 0, 0, m_renderer.getFrameWidth(), m_renderer.getFrameHeight(), 
-				0, 0, 0, m_renderer.getFrameHeight(), m_rawImageData, m_renderer.getBitmapInfo(), DIB_RGB_COLORS);
-
-			std::string output("Max Iterations: " + Helpers::toString(m_maxIterations));
-			TextOut(*m_renderer.getBackHdc(), 50, 50, output.c_str(), output.size());
-
-			m_renderer.push();
+			// Only the tiles that changed are presented, and nothing at all once the frame is complete.
+			m_presenter->setOverlay("Max Iterations: " + Helpers::toString(m_frameView.maxIterations) +
+				(m_autoIterations ? " (auto)" : ""));
+			m_presenter->present(m_colourData);
 
 			m_renderTimer = time;
 		}
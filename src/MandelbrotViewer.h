@@ -8,10 +8,24 @@
 
 #include "Renderer.h"
 #include "InputManager.h"
+#include "InputTrace.h"
 #include "Logging.h"
+#include "Palette.h"
+#include "Presenter.h"
+#include "Snapshot.h"
+#include "TiledBuffer.h"
+#include "TileOrder.h"
+#include "View.h"
+#include "ViewCache.h"
+#include "WorkerPool.h"
 
 #include "windows.h"
 
+#include <atomic>
+#include <complex>
+#include <mutex>
+#include <random>
+#include <string>
 #include <thread>
 #include <ctime>
 #include <vector>
@@ -24,8 +38,22 @@ public:
 	{
 		INIT_STATE,
 		GENERATING_STATE,
+		ANTIALIASING_STATE,
+		COLOURING_STATE,
 		COMPLETE_STATE
 	};
+
+	// What a frame shows: the escape time of each pixel, its estimated
+	// distance to the set, or the density of the orbits of escaping
+	// (Buddhabrot) or trapped (anti-Buddhabrot) points.
+	enum RenderMode
+	{
+		ESCAPE_TIME_MODE,
+		DISTANCE_MODE,
+		BUDDHABROT_MODE,
+		ANTI_BUDDHABROT_MODE,
+		RENDER_MODE_COUNT
+	};
 	
 	// Viewer domensions
 	static const int SCREEN_WIDTH = 1024;
@@ -42,23 +70,169 @@ public:
 
 	bool isQuitting();
 	void setQuitting(bool state);
+	void setFrameBudget(int milliseconds);
+
+	// Records the session's input to a trace, saved when the viewer is
+	// destroyed. Call before init().
+	void recordInput(const char* path);
+
+	// Replays a recorded trace in place of live input, without presenting,
+	// then quits. Call before init(). Returns false if the trace cannot be read.
+	bool replayInput(const char* path);
+	bool isReplaying();
+
+	// Runs the benchmarks and the fixed-point check once init() has started
+	// the workers, logging their results. Call before init().
+	void runBenchmarks();
 
 	Renderer* getRenderer();
 
+	// The viewer's workers, which a RenderService can share for batch jobs.
+	WorkerPool* getWorkerPool();
+
 private:
 	static const bool BENCHMARK = true;
+
+	// Each pass is split into THREAD_COUNT_X * THREAD_COUNT_Y slices,
+	// which are queued on the worker pool.
 	static const unsigned int THREAD_COUNT_X = 3;
 	static const unsigned int THREAD_COUNT_Y = 3;
+
+	// Worker pool topology. Slices are spread over the NUMA nodes in
+	// memory order, and each node's workers first touch the tiles it owns.
+	static const bool PIN_WORKERS = true;
+	static const int NUMA_NODE_LIMIT = 0; // 0 uses every node
+	static const int WORKERS_PER_NODE = 0; // 0 uses one worker per processor
+
+	// Tile ordering used for interactive renders. A centre-out spiral shows
+	// the middle of the view, where the user is looking, first.
+	static const TileOrder::Ordering INTERACTIVE_ORDERING = TileOrder::SPIRAL;
 	static const unsigned int UPDATE_DELAY = 50;
 	static const unsigned int RENDER_DELAY = 50;
 
+	// Frames are refined progressively, one sample per COARSEST_REFINEMENT
+	// square pixels first, halving the step each level. Input during a frame
+	// only supersedes it once a level is complete and FRAME_BUDGET ms have passed.
+	static const int COARSEST_REFINEMENT = 8;
+	static const int FRAME_BUDGET = 100;
+
+	// Speculative rendering. While idle, the views reached by repeating the
+	// last navigation step up to SPECULATION_DEPTH times are rendered into a
+	// cache, as long as the last navigation was within SPECULATION_WINDOW ms.
+	// Cached views are packed, so the cache holds SPECULATION_CACHE_SIZE views
+	// in roughly the memory four full buffers would take.
+	static const bool SPECULATION = true;
+	static const int SPECULATION_DEPTH = 2;
+	static const int SPECULATION_CACHE_SIZE = 12;
+	static const int SPECULATION_WINDOW = 3000;
+
+	// When the view changes, the previous frame is resampled into the new
+	// view as a preview. Unreliable preview pixels are recomputed first,
+	// then the reliable ones.
+	static const bool REPROJECTION = true;
+	static const unsigned int PREVIEW_UNRELIABLE = 0;
+	static const unsigned int PREVIEW_RELIABLE = 1;
+
+	// The set is symmetric about the real axis. When the view straddles it
+	// and the pixel rows line up on both sides, the rows of the smaller
+	// half are copied from their mirror images instead of computed.
+	// Anti-aliasing refines them as it does any other row.
+	static const bool SYMMETRY = true;
+
+	// Automatic iteration limit. A sparse grid over the view is iterated
+	// with a limit that doubles from a floor set by the zoom depth, until a
+	// doubling lets few more grid points escape, or the grid has used its
+	// share of the frame budget. The frame's limit is then picked from the
+	// escape times the grid saw. I toggles it, and + and - switch back to a
+	// manual limit.
+	static const bool AUTO_ITERATIONS = true;
+	static const int AUTO_GRID_X = 32;
+	static const int AUTO_GRID_Y = 24;
+	static const int AUTO_MIN_ITERATIONS = 128;
+	static const int AUTO_MAX_ITERATIONS = 16384;
+	static const int AUTO_ITERATIONS_PER_OCTAVE = 32;
+
+	// Bounds on the manual iteration limit, which + and - change by
+	// ITERATION_STEP. Restored sessions are held to the same bounds.
+	static const int MIN_ITERATIONS = 8;
+	static const int MAX_ITERATIONS = 1 << 20;
+	static const int ITERATION_STEP = 8;
+
+	// Session snapshots. Every completed frame, and any frame SPACEBAR is
+	// pressed during, is saved, and the last one is restored at startup.
+	// Frames that take longer than CHECKPOINT_INTERVAL ms are also saved
+	// at each refinement level, so long renders resume where they stopped.
+	static const bool RESTORE_SESSION = true;
+	static const int CHECKPOINT_INTERVAL = 5000;
+
+	// Stores fractional escape times, which gives smooth colour gradients
+	static const bool SMOOTH_COLOURING = true;
+
+	// Renders shallow escape-time views with the fixed-point kernel, which
+	// iterates two points at a time on integers. The double kernel is used
+	// once pixels are too close together for its precision. The -benchmark
+	// check compares the kernels over a FIXED_CHECK_WIDTH x FIXED_CHECK_HEIGHT
+	// grid of the whole set.
+	static const bool FIXED_POINT = true;
+	static const int FIXED_CHECK_WIDTH = 512;
+	static const int FIXED_CHECK_HEIGHT = 384;
+	static const int FIXED_CHECK_ITERATIONS = 512;
+
+	// Adaptive anti-aliasing settings.
+	// Pixels whose escape time differs from a neighbour by more than
+	// AA_THRESHOLD iterations receive extra jittered samples,
+	// up to AA_MAX_SAMPLES per pixel including the original one.
+	static const bool ANTIALIASING = true;
+	static const int AA_THRESHOLD = 4;
+	static const int AA_MIN_SAMPLES = 4;
+	static const int AA_MAX_SAMPLES = 16;
+
+	// Also refines escaping pixels below AA_THRESHOLD unless the distance
+	// estimate proves them clear of the set, as then their smooth escape
+	// time barely varies across the pixel.
+	static const bool AA_DISTANCE_TEST = true;
+
+	// Orbit density renders. Every slice traces ORBIT_BATCH_SAMPLES points
+	// per batch into its own histogram, and the histograms are summed and
+	// shown after each batch. The frame is complete after ORBIT_BATCHES.
+	static const int ORBIT_BATCH_SAMPLES = 20000;
+	static const int ORBIT_BATCHES = 100;
+
+	// Metropolis-Hastings state of one slice's orbit sampler.
+	// The current point is splatted once it is left, weighted by how many
+	// steps it was held for over the number of its orbit points in view.
+	struct OrbitSampler
+	{
+		std::mt19937 random;
+		std::complex<double> c;
+		double contribution;
+		int repeats;
+	};
+
 	bool m_quitting;
 	bool m_needRedraw;
 	bool m_renderThreadInterrupt;
 	bool m_updateThreadInterrupt;
 	bool m_computeThreadInterrupt;
+	bool m_needRecolour;
 
 	int m_maxIterations;
+	bool m_autoIterations;
+
+	// Cleared if the fixed-point check finds the kernels disagree
+	bool m_fixedPoint;
+	int m_autoIterationCount;
+	int m_frameBudget;
+
+	// The auto-iteration grid, which the probe slices iterate in parallel
+	std::vector<std::complex<double> > m_probePoints;
+	std::vector<std::complex<double> > m_probeZ;
+	std::vector<int> m_probeIterations;
+	std::vector<char> m_probeActive;
+	int m_probeLimit;
+	std::atomic<int> m_probeEscaped;
+	int m_refinementStep;
+	int m_refinementCoarsest;
 
 	double m_leftSetValue;
 	double m_rightSetValue;
@@ -66,7 +240,78 @@ private:
 	double m_bottomSetValue;
 	double m_zoomFactor;
 
+	// The view being rendered. The values above can change while it renders.
+	View m_frameView;
+	View m_previousFrameView;
+	int m_previewPass;
+	bool m_hasPreviousFrame;
+	RenderMode m_renderMode;
+	RenderMode m_frameMode;
+
+	// A frame restored from a snapshot, resumed by the first frame if its view matches
+	bool m_hasRestoredFrame;
+	View m_restoredView;
+	RenderMode m_restoredMode;
+	int m_restoredStep;
+	bool m_needSnapshot;
+	bool m_snapshotCurrent;
+	clock_t m_lastCheckpoint;
+
+	// Input recording and replay
+	InputTrace m_trace;
+	std::string m_tracePath;
+	bool m_recording;
+	bool m_replaying;
+	bool m_benchmarking;
+	std::atomic<bool> m_replayFinished;
+	clock_t m_replayStart;
+
+	// An interaction runs from the first input that needs a redraw until a
+	// frame reflecting all of its input completes. Written by the run thread,
+	// except for the pending input, which the update thread sets under m_navigationMutex.
+	struct Interaction
+	{
+		int start;
+		int firstFrame;
+		int finalFrame;
+		int cancelledFrames;
+		int cancelledTime;
+	};
+
+	bool m_inputPending;
+	clock_t m_inputTime;
+	bool m_interactionOpen;
+	Interaction m_interaction;
+	std::vector<Interaction> m_interactions;
+	int m_cancelledFrames;
+	int m_cancelledTime;
+
+	// Rows mirrorLow to mirrorHigh - 1 of the frame are copies of
+	// row m_mirrorSum - y. The range is empty when there is no mirror.
+	int m_mirrorSum;
+	int m_mirrorLow;
+	int m_mirrorHigh;
+
+	ViewCache m_viewCache;
+	ViewCache::Entry* m_speculativeEntry;
+	View m_speculativeView;
+
+	// The speculative view is refined here, and packed into its entry as each level completes
+	TiledBuffer<float> m_speculativeData;
+	int m_speculationStep;
+	bool m_speculating;
+	bool m_speculationInterrupt;
+	clock_t m_speculationTimer;
+	int m_speculationTime;
+
+	// The last change input made to the view, written by the update thread
+	std::mutex m_navigationMutex;
+	View m_navigationStep;
+	clock_t m_lastNavigationTime;
+	bool m_hasNavigationStep;
+
 	State m_state;
+	TileOrder::Ordering m_tileOrdering;
 	Renderer m_renderer;
 	InputManager m_inputMgr;
 	Logging m_log;
@@ -74,16 +319,116 @@ private:
 	clock_t m_computeTimer;
 	clock_t m_renderTimer;
 	clock_t m_updateTimer;
+	clock_t m_antialiasTimer;
+	clock_t m_colourTimer;
+
+	// Escape times and colours are stored in tiles owned by one thread each.
+	// The colours are only converted to the linear DIB layout when presented,
+	// and then only the tiles colouring changed since the last present.
+	TiledBuffer<float> m_iterationData;
+	TiledBuffer<float> m_aliasedIterationData;
+	TiledBuffer<unsigned int> m_colourData;
+	TiledBuffer<unsigned int> m_previewMask;
+	std::atomic<int> m_reliablePixels;
+	Presenter* m_presenter;
+	std::atomic<int> m_aaExtraSamples;
+	std::atomic<int> m_aaPixels;
+	std::atomic<int> m_aaDistanceRejects;
+
+	// Tiles the distance estimate has proven to lie far outside the set,
+	// which the distance mode fills without computing.
+	std::vector<unsigned char> m_exteriorTiles;
+	std::atomic<int> m_exteriorTileCount;
+	std::atomic<int> m_centreTilesRemaining;
+	clock_t m_centreCompleteTime;
+
+	std::vector<Palette*> m_palettes;
+	int m_paletteIndex;
+	int m_builtPaletteIndex;
+	std::mutex m_paletteMutex;
+	std::vector<std::vector<unsigned int> > m_sliceHistograms;
+
+	// Each slice accumulates orbits into its own histogram, so the sampling
+	// needs no atomics. They are reduced into m_aliasedIterationData.
+	TiledBuffer<float> m_orbitHistograms[THREAD_COUNT_X * THREAD_COUNT_Y];
+	OrbitSampler m_orbitSamplers[THREAD_COUNT_X * THREAD_COUNT_Y];
+	float m_orbitSliceDensity[THREAD_COUNT_X * THREAD_COUNT_Y];
+	float m_orbitMaxDensity;
+	int m_orbitBatch;
+	WorkerPool m_pool;
 
-	unsigned char* m_rawImageData;
-	std::vector<std::thread*> m_computeThreads;
+	// The viewer's own slices, by priority class, so that it never waits
+	// on the jobs of a RenderService sharing the pool.
+	WorkerPool::TaskGroup m_sliceGroups[WorkerPool::PRIORITY_COUNT];
 	std::thread* m_renderThread;
 	std::thread* m_updateThread;
 
-	void startComputeThreads();
+	void startFrame();
+	bool resumeRestoredFrame();
+	Snapshot::Session getSession(int refinementStep);
+	bool isValidSession(const Snapshot::Session& session) const;
+	void applySession(const Snapshot::Session& session);
+	void saveSnapshot(int refinementStep);
+	void restoreSnapshot();
+	void onFrameShown();
+	void onFrameComplete();
+	void onFrameCancelled();
+	void logInteractionReport();
+	void startOrbitFrame();
+	int chooseIterations(const View& view);
+	void probeSlice(int sliceIdX, int sliceIdY);
+	void finishOrbitBatch();
+	void speculate();
+	void stopSpeculation();
+	void logSpeculationStats();
+	View getCurrentView();
+	void startWorkers(int maxNodes);
+	void startComputeThreads(void (MandelbrotViewer::*slice)(int, int));
+	void startComputeThreads(void (MandelbrotViewer::*slice)(int, int), WorkerPool::Priority priority);
 	void joinComputeThreads();
+	void joinComputeThreads(WorkerPool::Priority priority);
+	void logQueueLatency();
+	void runScalingBenchmark();
+	void runOrderingBenchmark();
+	void runFixedPointCheck();
 	void update();
-	void computeMandelbrotSet(int sliceId, int sliceIdX);
+	void computeSliceBounds(int sliceIdX, int sliceIdY, int& lowBoundX, int& lowBoundY,
+							int& highBoundX, int& highBoundY);
+	void computeSliceTiles(int sliceIdX, int sliceIdY, int& lowTileX, int& lowTileY,
+						   int& highTileX, int& highTileY);
+	std::vector<TileOrder::Tile> orderSliceTiles(int sliceIdX, int sliceIdY);
+	bool isCentreTile(int tileX, int tileY);
+	void resetCentreTracking();
+	int getSliceNode(int sliceIdX, int sliceIdY);
+	void clearSlice(int sliceIdX, int sliceIdY);
+	void findMirrorRows(const View& view);
+	void mirrorSlice(int sliceIdX, int sliceIdY);
+	bool usesFixedPoint(const View& view);
+	float computePoint(const View& view, double x, double y);
+	void computePoints(const View& view, const double x[2], double y, float values[2]);
+	float computeDistance(const View& view, double x, double y);
+	void computeDistances(const View& view, const double x[2], double y, float shades[2]);
+	float samplePoint(const View& view, double x, double y);
+	void samplePoints(const View& view, const double x[2], double y, float values[2]);
+	bool isTileExterior(const View& view, int tileX, int tileY);
+	void computeMandelbrotSet(int sliceIdX, int sliceIdY);
+	void computeSpeculativeSlice(int sliceIdX, int sliceIdY);
+	bool refineSlice(int sliceIdX, int sliceIdY, const View& view, TiledBuffer<float>& data,
+					 int step, bool firstLevel, const bool* interrupt, bool trackCentre,
+					 const TiledBuffer<unsigned int>* mask, unsigned int maskValue, bool skipMirrored);
+	bool hasCompleteFrame();
+	double traceOrbit(const View& view, std::complex<double> c, TiledBuffer<float>* histogram, float weight);
+	void traceOrbits(int sliceIdX, int sliceIdY);
+	void reduceOrbitSlice(int sliceIdX, int sliceIdY);
+	void mapOrbitSlice(int sliceIdX, int sliceIdY);
+	void reprojectSlice(int sliceIdX, int sliceIdY);
+	void computeAntialiasing(int sliceIdX, int sliceIdY);
+	int antialiasPixel(int x, int y);
+	void computeHistogram(int sliceIdX, int sliceIdY);
+	void buildPalette();
+	void startColouring();
+	void colourTiles(int lowTileX, int lowTileY, int highTileX, int highTileY);
+	void colourSlice(int sliceIdX, int sliceIdY);
 	void render();
 };
 
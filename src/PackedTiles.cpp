@@ -0,0 +1,263 @@
+#include "PackedTiles.h"
+#include "Palette.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include <emmintrin.h>
+
+PackedTiles::PackedTiles() : m_width(0), m_height(0), m_tilesX(0), m_tilesY(0) { }
+
+
+PackedTiles::~PackedTiles()
+{
+	clear();
+}
+
+
+void PackedTiles::init(int width, int height)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	clear();
+
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + tileSize - 1) / tileSize;
+	m_tilesY = (height + tileSize - 1) / tileSize;
+
+	Tile uncomputed = { -Palette::LUT_SCALE, UNIFORM, nullptr };
+	m_tiles.assign(m_tilesX * m_tilesY, uncomputed);
+}
+
+
+// The payload is only reallocated when the tile's format changes.
+void PackedTiles::packTile(int tileX, int tileY, const float* values)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+
+	unsigned char payload[MAX_PAYLOAD];
+	int base;
+	const Format format = encodeTile(values, std::min(tileSize, m_width - tileX * tileSize),
+		std::min(tileSize, m_height - tileY * tileSize), base, payload);
+
+	Tile& tile = m_tiles[tileY * m_tilesX + tileX];
+
+	if (tile.format != format)
+	{
+		delete[] tile.payload;
+		tile.payload = format == UNIFORM ? nullptr : new unsigned char[getPayloadSize(format)];
+		tile.format = format;
+	}
+
+	tile.base = base;
+
+	if (format != UNIFORM)
+		memcpy(tile.payload, payload, getPayloadSize(format));
+}
+
+
+void PackedTiles::unpackTile(int tileX, int tileY, float* values) const
+{
+	const Tile& tile = m_tiles[tileY * m_tilesX + tileX];
+
+	decodeTile(tile.format, tile.base, tile.payload, values);
+}
+
+
+void PackedTiles::pack(const TiledBuffer<float>& buffer)
+{
+	for (int tileY = 0; tileY < m_tilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_tilesX; ++tileX)
+			packTile(tileX, tileY, buffer.getTile(tileX, tileY));
+	}
+}
+
+
+void PackedTiles::unpack(TiledBuffer<float>& buffer) const
+{
+	for (int tileY = 0; tileY < m_tilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_tilesX; ++tileX)
+			unpackTile(tileX, tileY, buffer.getTile(tileX, tileY));
+	}
+}
+
+
+float PackedTiles::at(int x, int y) const
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+	const Tile& tile = m_tiles[(y / tileSize) * m_tilesX + (x / tileSize)];
+	const int index = (y % tileSize) * tileSize + (x % tileSize);
+	unsigned int offset = 0;
+
+	if (tile.format == BITS_8)
+	{
+		offset = tile.payload[index];
+	}
+	else if (tile.format == BITS_16)
+	{
+		unsigned short word;
+		memcpy(&word, &tile.payload[index * sizeof(word)], sizeof(word));
+		offset = word;
+	}
+	else if (tile.format == BITS_32)
+	{
+		memcpy(&offset, &tile.payload[index * sizeof(offset)], sizeof(offset));
+	}
+
+	return (float) (tile.base + (int) offset) / (float) Palette::LUT_SCALE;
+}
+
+
+PackedTiles::Format PackedTiles::getFormat(int tileX, int tileY) const
+{
+	return m_tiles[tileY * m_tilesX + tileX].format;
+}
+
+
+size_t PackedTiles::getStoredBytes() const
+{
+	size_t bytes = m_tiles.size() * sizeof(Tile);
+
+	for (std::vector<Tile>::const_iterator iter = m_tiles.begin(); iter != m_tiles.end(); ++iter)
+		bytes += getPayloadSize(iter->format);
+
+	return bytes;
+}
+
+
+// Values beyond the columns and rows given, the padding of edge tiles,
+// are stored as the base, so they never widen the tile's range.
+PackedTiles::Format PackedTiles::encodeTile(const float* values, int columns, int rows, int& base, unsigned char* payload)
+{
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+	const int tileArea = TiledBuffer<float>::TILE_AREA;
+	const float scale = (float) Palette::LUT_SCALE;
+
+	int steps[tileArea];
+	int lowest = INT_MAX;
+	int highest = INT_MIN;
+
+	for (int row = 0; row < rows; ++row)
+	{
+		for (int column = 0; column < columns; ++column)
+		{
+			const int index = row * tileSize + column;
+
+			steps[index] = (int) floor(values[index] * scale);
+			lowest = std::min(lowest, steps[index]);
+			highest = std::max(highest, steps[index]);
+		}
+	}
+
+	if (lowest > highest)
+	{
+		base = -Palette::LUT_SCALE;
+		return UNIFORM;
+	}
+
+	base = lowest;
+
+	const unsigned int range = (unsigned int) highest - (unsigned int) lowest;
+	const Format format = range == 0 ? UNIFORM : range <= 0xFF ? BITS_8 : range <= 0xFFFF ? BITS_16 : BITS_32;
+
+	if (format == UNIFORM)
+		return format;
+
+	for (int index = 0; index < tileArea; ++index)
+	{
+		const bool inside = index % tileSize < columns && index / tileSize < rows;
+		const unsigned int offset = inside ? (unsigned int) steps[index] - (unsigned int) base : 0;
+
+		if (format == BITS_8)
+		{
+			payload[index] = (unsigned char) offset;
+		}
+		else if (format == BITS_16)
+		{
+			const unsigned short word = (unsigned short) offset;
+			memcpy(&payload[index * sizeof(word)], &word, sizeof(word));
+		}
+		else
+		{
+			memcpy(&payload[index * sizeof(offset)], &offset, sizeof(offset));
+		}
+	}
+
+	return format;
+}
+
+
+// Offsets are widened to 32 bits by interleaving them with zeros, then the
+// base is added and the steps are scaled back to iterations, four at a time.
+void PackedTiles::decodeTile(Format format, int base, const unsigned char* payload, float* values)
+{
+	const int tileArea = TiledBuffer<float>::TILE_AREA;
+
+	const __m128 step = _mm_set1_ps(1.0f / (float) Palette::LUT_SCALE);
+	const __m128i baseSteps = _mm_set1_epi32(base);
+	const __m128i zero = _mm_setzero_si128();
+
+	auto store = [&](float* destination, __m128i offsets)
+	{
+		_mm_storeu_ps(destination, _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(offsets, baseSteps)), step));
+	};
+
+	if (format == UNIFORM)
+	{
+		const __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(baseSteps), step);
+
+		for (int i = 0; i < tileArea; i += 4)
+			_mm_storeu_ps(&values[i], value);
+	}
+	else if (format == BITS_8)
+	{
+		for (int i = 0; i < tileArea; i += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128((const __m128i*) &payload[i]);
+			const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+			store(&values[i], _mm_unpacklo_epi16(low, zero));
+			store(&values[i + 4], _mm_unpackhi_epi16(low, zero));
+			store(&values[i + 8], _mm_unpacklo_epi16(high, zero));
+			store(&values[i + 12], _mm_unpackhi_epi16(high, zero));
+		}
+	}
+	else if (format == BITS_16)
+	{
+		for (int i = 0; i < tileArea; i += 8)
+		{
+			const __m128i words = _mm_loadu_si128((const __m128i*) &payload[i * 2]);
+
+			store(&values[i], _mm_unpacklo_epi16(words, zero));
+			store(&values[i + 4], _mm_unpackhi_epi16(words, zero));
+		}
+	}
+	else
+	{
+		for (int i = 0; i < tileArea; i += 4)
+			store(&values[i], _mm_loadu_si128((const __m128i*) &payload[i * 4]));
+	}
+}
+
+
+int PackedTiles::getPayloadSize(Format format)
+{
+	static const int BYTES_PER_VALUE[FORMAT_COUNT] = { 0, 1, 2, 4 };
+
+	return BYTES_PER_VALUE[format] * TiledBuffer<float>::TILE_AREA;
+}
+
+
+void PackedTiles::clear()
+{
+	for (std::vector<Tile>::iterator iter = m_tiles.begin(); iter != m_tiles.end(); ++iter)
+		delete[] iter->payload;
+
+	m_tiles.clear();
+}
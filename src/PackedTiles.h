@@ -0,0 +1,92 @@
+/* PackedTiles.h
+ *
+ * Escape times stored compactly, tile by tile, for buffers that are kept
+ * rather than refined: cached views, snapshots and rendered results.
+ * Values are stored in whole steps of 1 / Palette::LUT_SCALE iterations,
+ * the finest difference a palette can show, so colouring unpacked values
+ * gives exactly the colours of the originals. Each tile stores its steps as
+ * offsets from its lowest value, in 8, 16 or 32 bits, whichever its range
+ * needs, and a tile of a single value, such as the inside of the set or an
+ * uncomputed tile, is stored as that value alone.
+ * Unpacking converts four values at a time with SSE2. */
+
+#ifndef PACKEDTILES_H
+#define PACKEDTILES_H
+
+#include "TiledBuffer.h"
+
+#include <cstddef>
+#include <vector>
+
+class PackedTiles
+{
+public:
+	enum Format
+	{
+		UNIFORM,
+		BITS_8,
+		BITS_16,
+		BITS_32,
+		FORMAT_COUNT
+	};
+
+	// Largest encoded tile, in bytes.
+	static const int MAX_PAYLOAD = TiledBuffer<float>::TILE_AREA * 4;
+
+	PackedTiles();
+	~PackedTiles();
+
+	// Sizes the buffer, with every value -1, as an uncomputed buffer holds.
+	void init(int width, int height);
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	int getTilesX() const { return m_tilesX; }
+	int getTilesY() const { return m_tilesY; }
+
+	// Packs or unpacks a tile of TILE_AREA values, laid out as in a
+	// TiledBuffer tile. Different tiles can be packed from different
+	// threads at once. Values outside the buffer's edges are not kept.
+	void packTile(int tileX, int tileY, const float* values);
+	void unpackTile(int tileX, int tileY, float* values) const;
+
+	void pack(const TiledBuffer<float>& buffer);
+	void unpack(TiledBuffer<float>& buffer) const;
+
+	// Returns the value at pixel x, y.
+	float at(int x, int y) const;
+
+	Format getFormat(int tileX, int tileY) const;
+
+	// Bytes taken by the buffer, including each tile's header.
+	size_t getStoredBytes() const;
+
+	// Encodes the first rows x columns values of a tile, in the tile's layout,
+	// into a base and a payload of getPayloadSize(format) bytes, and returns the format.
+	static Format encodeTile(const float* values, int columns, int rows, int& base, unsigned char* payload);
+
+	// Decodes a whole tile. The payload need not be aligned.
+	static void decodeTile(Format format, int base, const unsigned char* payload, float* values);
+
+	static int getPayloadSize(Format format);
+
+private:
+	struct Tile
+	{
+		int base;
+		Format format;
+		unsigned char* payload;
+	};
+
+	std::vector<Tile> m_tiles;
+	int m_width, m_height;
+	int m_tilesX, m_tilesY;
+
+	void clear();
+
+	// Not copyable, the buffer owns its tiles' payloads.
+	PackedTiles(const PackedTiles&);
+	PackedTiles& operator=(const PackedTiles&);
+};
+
+#endif // PACKEDTILES_H
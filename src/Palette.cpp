@@ -0,0 +1,176 @@
+#include "Palette.h"
+
+#include <cmath>
+#include <cstdlib>
+
+// Colour stops for the shared gradient, as red, green, blue.
+static const int GRADIENT_STOPS[][3] = {
+	{ 0, 7, 100 },
+	{ 32, 107, 203 },
+	{ 237, 255, 255 },
+	{ 255, 170, 0 },
+	{ 0, 2, 0 }
+};
+
+static const int GRADIENT_STOP_COUNT = sizeof(GRADIENT_STOPS) / sizeof(GRADIENT_STOPS[0]);
+
+
+// Rebuilds the lookup table.
+// Entry i holds the colour for an escape time of i / LUT_SCALE, and the
+// final entry holds the colour for points inside the set.
+void Palette::build(int maxIterations, const std::vector<unsigned int>& histogram)
+{
+	if (maxIterations < 1)
+		maxIterations = 1;
+
+	prepare(maxIterations, histogram);
+
+	m_lut.resize(maxIterations * LUT_SCALE + 1);
+
+	for (int i = 0; i < (int) m_lut.size(); ++i)
+		m_lut[i] = colourAt((float) i / (float) LUT_SCALE, maxIterations);
+}
+
+
+bool Palette::needsHistogram()
+{
+	return false;
+}
+
+
+// Returns a pointer to the lookup table.
+const unsigned int* Palette::getLut()
+{
+	return m_lut.data();
+}
+
+
+// Returns the number of entries in the lookup table.
+int Palette::getLutSize()
+{
+	return (int) m_lut.size();
+}
+
+
+void Palette::prepare(int, const std::vector<unsigned int>&) { }
+
+
+// Packs three 0-255 channels into the 0x00RRGGBB layout used by DIBs.
+unsigned int Palette::packColour(int red, int green, int blue)
+{
+	return ((unsigned int) (red & 0xFF) << 16) | ((unsigned int) (green & 0xFF) << 8) | (unsigned int) (blue & 0xFF);
+}
+
+
+// Returns the gradient colour at a position in [0, 1].
+unsigned int Palette::gradient(float position)
+{
+	if (position <= 0.0f)
+		return packColour(GRADIENT_STOPS[0][0], GRADIENT_STOPS[0][1], GRADIENT_STOPS[0][2]);
+
+	if (position >= 1.0f)
+	{
+		const int* last = GRADIENT_STOPS[GRADIENT_STOP_COUNT - 1];
+		return packColour(last[0], last[1], last[2]);
+	}
+
+	const float scaled = position * (float) (GRADIENT_STOP_COUNT - 1);
+	const int stop = (int) scaled;
+	const float blend = scaled - (float) stop;
+
+	const int* from = GRADIENT_STOPS[stop];
+	const int* to = GRADIENT_STOPS[stop + 1];
+
+	return packColour((int) (from[0] + (to[0] - from[0]) * blend),
+		(int) (from[1] + (to[1] - from[1]) * blend),
+		(int) (from[2] + (to[2] - from[2]) * blend));
+}
+
+
+const char* ClassicPalette::getName()
+{
+	return "Classic";
+}
+
+
+unsigned int ClassicPalette::colourAt(float iterations, int maxIterations)
+{
+	const int whole = (int) iterations;
+
+	return packColour(abs(whole - maxIterations / 3),
+		abs(whole - maxIterations / 2),
+		abs(whole - maxIterations));
+}
+
+
+const char* GradientPalette::getName()
+{
+	return "Gradient";
+}
+
+
+unsigned int GradientPalette::colourAt(float iterations, int maxIterations)
+{
+	if (iterations >= (float) maxIterations)
+		return packColour(0, 0, 0);
+
+	// Run the gradient forwards then backwards so the cycle has no seam.
+	const float cycle = fmod(iterations / (float) CYCLE_LENGTH, 2.0f);
+
+	return gradient(cycle < 1.0f ? cycle : 2.0f - cycle);
+}
+
+
+const char* HistogramPalette::getName()
+{
+	return "Histogram";
+}
+
+
+bool HistogramPalette::needsHistogram()
+{
+	return true;
+}
+
+
+// Builds the cumulative distribution of the escaping pixels.
+// Points inside the set are left out so that they do not squash
+// the rest of the gradient.
+void HistogramPalette::prepare(int maxIterations, const std::vector<unsigned int>& histogram)
+{
+	m_cdf.assign(maxIterations + 1, 0.0f);
+
+	double total = 0.0;
+
+	for (int i = 0; i < maxIterations && i < (int) histogram.size(); ++i)
+		total += histogram[i];
+
+	if (total == 0.0)
+		return;
+
+	double running = 0.0;
+
+	for (int i = 0; i < maxIterations; ++i)
+	{
+		m_cdf[i] = (float) (running / total);
+
+		if (i < (int) histogram.size())
+			running += histogram[i];
+	}
+
+	m_cdf[maxIterations] = 1.0f;
+}
+
+
+unsigned int HistogramPalette::colourAt(float iterations, int maxIterations)
+{
+	if (iterations >= (float) maxIterations)
+		return packColour(0, 0, 0);
+
+	// Interpolate between whole escape times for smooth values.
+	const int whole = (int) iterations;
+	const float blend = iterations - (float) whole;
+	const float position = m_cdf[whole] + (m_cdf[whole + 1] - m_cdf[whole]) * blend;
+
+	return gradient(position);
+}
@@ -0,0 +1,93 @@
+/* Palette.h
+ * 
+ * Colour lookup tables mapping escape times onto pixel colours.
+ * The set is stored as raw escape times, so switching or rebuilding
+ * a palette only needs a colouring pass, not a fresh render. */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <vector>
+
+class Palette
+{
+public:
+	// Number of lookup table entries per iteration, so that
+	// fractional (smooth) escape times get distinct colours.
+	static const int LUT_SCALE = 8;
+
+	Palette() { }
+	virtual ~Palette() { }
+
+	// Rebuilds the lookup table for the given iteration limit.
+	// The histogram holds a pixel count per whole escape time and is
+	// only read by palettes that return true from needsHistogram().
+	void build(int maxIterations, const std::vector<unsigned int>& histogram);
+
+	virtual const char* getName() = 0;
+	virtual bool needsHistogram();
+
+	const unsigned int* getLut();
+	int getLutSize();
+
+protected:
+	// Called once per build, before any calls to colourAt().
+	virtual void prepare(int maxIterations, const std::vector<unsigned int>& histogram);
+
+	// Returns the packed 0x00RRGGBB colour for an escape time.
+	virtual unsigned int colourAt(float iterations, int maxIterations) = 0;
+
+	static unsigned int packColour(int red, int green, int blue);
+	static unsigned int gradient(float position);
+
+private:
+	std::vector<unsigned int> m_lut;
+};
+
+
+// The original banded colouring: each channel is the distance of
+// the escape time from a fraction of the iteration limit.
+class ClassicPalette : public Palette
+{
+public:
+	const char* getName();
+
+protected:
+	unsigned int colourAt(float iterations, int maxIterations);
+};
+
+
+// A repeating gradient, best used with smooth escape times.
+class GradientPalette : public Palette
+{
+public:
+	const char* getName();
+
+protected:
+	unsigned int colourAt(float iterations, int maxIterations);
+
+private:
+	// Number of iterations covered by one cycle of the gradient.
+	static const int CYCLE_LENGTH = 64;
+};
+
+
+// Histogram equalisation: escape times are spread over the gradient
+// in proportion to how many pixels share them, so the colours adapt
+// to whatever range of escape times the current view contains.
+class HistogramPalette : public Palette
+{
+public:
+	const char* getName();
+	bool needsHistogram();
+
+protected:
+	void prepare(int maxIterations, const std::vector<unsigned int>& histogram);
+	unsigned int colourAt(float iterations, int maxIterations);
+
+private:
+	// Cumulative fraction of escaping pixels below each escape time.
+	std::vector<float> m_cdf;
+};
+
+#endif // PALETTE_H
@@ -0,0 +1,253 @@
+#include "Presenter.h"
+
+#include <algorithm>
+
+Presenter::Presenter() : m_width(0), m_height(0), m_tilesX(0), m_tilesY(0), m_invalid(false),
+	m_overlayWidth(0), m_overlayHeight(0)
+{
+	resetStats();
+}
+
+
+void Presenter::init(int width, int height)
+{
+	const int tileSize = TiledBuffer<unsigned int>::TILE_SIZE;
+
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + tileSize - 1) / tileSize;
+	m_tilesY = (height + tileSize - 1) / tileSize;
+
+	// Atomics cannot be copied or moved, so the flags are swapped in rather than resized
+	std::vector<std::atomic<unsigned char> > dirtyTiles(m_tilesX * m_tilesY);
+	m_dirtyTiles.swap(dirtyTiles);
+
+	markDirty(0, 0, m_tilesX, m_tilesY);
+	m_invalid = true;
+}
+
+
+// The flag is set after the tile's colours are written, and cleared by
+// present() before it reads them, so a tile that changes during a present
+// is always presented again by the next one.
+void Presenter::markDirty(int tileX, int tileY)
+{
+	m_dirtyTiles[tileY * m_tilesX + tileX].store(1, std::memory_order_release);
+}
+
+
+void Presenter::markDirty(int lowTileX, int lowTileY, int highTileX, int highTileY)
+{
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+			markDirty(tileX, tileY);
+	}
+}
+
+
+void Presenter::invalidate()
+{
+	m_invalid = true;
+}
+
+
+void Presenter::setOverlay(const std::string& text)
+{
+	m_overlay = text;
+}
+
+
+// A changed overlay dirties the tiles under both the old and the new text,
+// so the old text is covered by the image before the new one is drawn.
+bool Presenter::present(const TiledBuffer<unsigned int>& colours)
+{
+	if (m_overlay != m_shownOverlay)
+	{
+		markOverlayDirty(m_overlayWidth, m_overlayHeight);
+		measureOverlay(m_overlay, m_overlayWidth, m_overlayHeight);
+		markOverlayDirty(m_overlayWidth, m_overlayHeight);
+
+		m_shownOverlay = m_overlay;
+	}
+
+	std::vector<Region> regions;
+	collectRegions(regions);
+
+	const bool invalid = m_invalid.exchange(false);
+
+	if (regions.empty() && !invalid)
+	{
+		m_statsMutex.lock();
+		++m_stats.skipped;
+		m_statsMutex.unlock();
+
+		return false;
+	}
+
+	const int tileSize = TiledBuffer<unsigned int>::TILE_SIZE;
+	bool overlayCovered = false;
+	int tiles = 0;
+	long long bytes = 0;
+
+	for (std::vector<Region>::iterator iter = regions.begin(); iter != regions.end(); ++iter)
+	{
+		upload(colours, iter->lowTileX, iter->lowTileY, iter->highTileX, iter->highTileY);
+
+		const int lowX = iter->lowTileX * tileSize;
+		const int lowY = iter->lowTileY * tileSize;
+		const int highX = std::min(iter->highTileX * tileSize, m_width);
+		const int highY = std::min(iter->highTileY * tileSize, m_height);
+
+		tiles += (iter->highTileX - iter->lowTileX) * (iter->highTileY - iter->lowTileY);
+		bytes += (long long) (highX - lowX) * (highY - lowY) * sizeof(unsigned int);
+
+		if (lowX < OVERLAY_X + m_overlayWidth && highX > OVERLAY_X &&
+			lowY < OVERLAY_Y + m_overlayHeight && highY > OVERLAY_Y)
+		{
+			overlayCovered = true;
+		}
+	}
+
+	// Uploading tiles under the overlay paints over it
+	if (overlayCovered && !m_shownOverlay.empty())
+		drawOverlay(m_shownOverlay);
+
+	if (invalid)
+	{
+		show(0, 0, m_width, m_height);
+	}
+	else
+	{
+		for (std::vector<Region>::iterator iter = regions.begin(); iter != regions.end(); ++iter)
+			showRegion(*iter);
+	}
+
+	m_statsMutex.lock();
+	++m_stats.presents;
+	m_stats.rectangles += (int) regions.size();
+	m_stats.tiles += tiles;
+	m_stats.bytes += bytes;
+	m_statsMutex.unlock();
+
+	return true;
+}
+
+
+Presenter::Stats Presenter::getStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+
+	return m_stats;
+}
+
+
+void Presenter::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+
+	m_stats.presents = 0;
+	m_stats.skipped = 0;
+	m_stats.rectangles = 0;
+	m_stats.tiles = 0;
+	m_stats.bytes = 0;
+}
+
+
+// Marks the tiles under overlay text of a size drawn at the overlay's position.
+void Presenter::markOverlayDirty(int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	const int tileSize = TiledBuffer<unsigned int>::TILE_SIZE;
+
+	markDirty(std::min(OVERLAY_X / tileSize, m_tilesX), std::min(OVERLAY_Y / tileSize, m_tilesY),
+		std::min((OVERLAY_X + width + tileSize - 1) / tileSize, m_tilesX),
+		std::min((OVERLAY_Y + height + tileSize - 1) / tileSize, m_tilesY));
+}
+
+
+// Clears the dirty tiles, gathering them into rectangles. Each row's runs
+// of dirty tiles are merged with a run of the same columns in the row above.
+void Presenter::collectRegions(std::vector<Region>& regions)
+{
+	for (int tileY = 0; tileY < m_tilesY; ++tileY)
+	{
+		int tileX = 0;
+
+		while (tileX < m_tilesX)
+		{
+			if (!m_dirtyTiles[tileY * m_tilesX + tileX].exchange(0, std::memory_order_acquire))
+			{
+				++tileX;
+				continue;
+			}
+
+			const int lowTileX = tileX++;
+
+			while (tileX < m_tilesX && m_dirtyTiles[tileY * m_tilesX + tileX].exchange(0, std::memory_order_acquire))
+				++tileX;
+
+			// Extend a region that ended on the row above, if one spans the same columns
+			std::vector<Region>::iterator iter = regions.begin();
+
+			while (iter != regions.end() && !(iter->highTileY == tileY && iter->lowTileX == lowTileX && iter->highTileX == tileX))
+				++iter;
+
+			if (iter != regions.end())
+			{
+				iter->highTileY = tileY + 1;
+			}
+			else
+			{
+				Region region = { lowTileX, tileY, tileX, tileY + 1 };
+				regions.push_back(region);
+			}
+		}
+	}
+}
+
+
+void Presenter::showRegion(const Region& region)
+{
+	const int tileSize = TiledBuffer<unsigned int>::TILE_SIZE;
+	const int x = region.lowTileX * tileSize;
+	const int y = region.lowTileY * tileSize;
+
+	show(x, y, std::min(region.highTileX * tileSize, m_width) - x, std::min(region.highTileY * tileSize, m_height) - y);
+}
+
+
+void HeadlessPresenter::init(int width, int height)
+{
+	Presenter::init(width, height);
+
+	m_image.assign(width * height, 0);
+}
+
+
+const std::vector<unsigned int>& HeadlessPresenter::getImage() const
+{
+	return m_image;
+}
+
+
+void HeadlessPresenter::upload(const TiledBuffer<unsigned int>& colours, int lowTileX, int lowTileY,
+							   int highTileX, int highTileY)
+{
+	colours.toLinear(&m_image[0], m_width, lowTileX, lowTileY, highTileX, highTileY);
+}
+
+
+void HeadlessPresenter::measureOverlay(const std::string& text, int& width, int& height)
+{
+	width = (int) text.size() * CHARACTER_WIDTH;
+	height = text.empty() ? 0 : CHARACTER_HEIGHT;
+}
+
+
+void HeadlessPresenter::drawOverlay(const std::string&) { }
+
+
+void HeadlessPresenter::show(int, int, int, int) { }
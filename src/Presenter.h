@@ -0,0 +1,125 @@
+/* Presenter.h
+ *
+ * Puts the colour buffer on screen. Colouring marks each tile whose colours
+ * changed as dirty, and a present only uploads and shows the dirty tiles,
+ * merged into rectangles, so presenting an idle view costs nothing.
+ * The headless presenter keeps the presented image in memory, so replays
+ * can measure presentation without a window. This file builds on any
+ * platform; the GDI presenter, which draws to the window, is in GdiPresenter.h. */
+
+#ifndef PRESENTER_H
+#define PRESENTER_H
+
+#include "TiledBuffer.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Presenter
+{
+public:
+	struct Stats
+	{
+		// Presents that showed something, and presents skipped as nothing had changed.
+		int presents;
+		int skipped;
+
+		int rectangles;
+		int tiles;
+		long long bytes;
+	};
+
+	Presenter();
+	virtual ~Presenter() { }
+
+	// Sizes the presenter for a frame, with every tile dirty.
+	virtual void init(int width, int height);
+
+	// Called by colouring threads after a tile's colours have changed.
+	void markDirty(int tileX, int tileY);
+	void markDirty(int lowTileX, int lowTileY, int highTileX, int highTileY);
+
+	// Shows the whole frame on the next present, as when the window has been uncovered.
+	void invalidate();
+
+	// Sets the text drawn over the top left of the frame.
+	void setOverlay(const std::string& text);
+
+	// Uploads and shows the tiles that changed since the last present.
+	// Returns false, without touching the screen, if nothing had changed.
+	// Presents must all come from one thread.
+	bool present(const TiledBuffer<unsigned int>& colours);
+
+	Stats getStats();
+	void resetStats();
+
+protected:
+	// Position of the overlay text, in pixels.
+	static const int OVERLAY_X = 50;
+	static const int OVERLAY_Y = 50;
+
+	int m_width, m_height;
+
+	// Copies a range of tiles into the image being presented.
+	virtual void upload(const TiledBuffer<unsigned int>& colours, int lowTileX, int lowTileY,
+						int highTileX, int highTileY) = 0;
+
+	virtual void measureOverlay(const std::string& text, int& width, int& height) = 0;
+	virtual void drawOverlay(const std::string& text) = 0;
+
+	// Shows a rectangle of the image, in pixels.
+	virtual void show(int x, int y, int width, int height) = 0;
+
+private:
+	// A rectangle of dirty tiles
+	struct Region
+	{
+		int lowTileX, lowTileY, highTileX, highTileY;
+	};
+
+	int m_tilesX, m_tilesY;
+	std::vector<std::atomic<unsigned char> > m_dirtyTiles;
+	std::atomic<bool> m_invalid;
+
+	// The overlay is set by the render thread, as are the bounds it was last drawn in
+	std::string m_overlay;
+	std::string m_shownOverlay;
+	int m_overlayWidth, m_overlayHeight;
+
+	std::mutex m_statsMutex;
+	Stats m_stats;
+
+	void markOverlayDirty(int width, int height);
+	void collectRegions(std::vector<Region>& regions);
+	void showRegion(const Region& region);
+};
+
+
+// Keeps the presented frame in memory. The overlay is measured as if
+// drawn in the system font, but not drawn.
+class HeadlessPresenter : public Presenter
+{
+public:
+	void init(int width, int height);
+
+	// The presented frame, in rows of the frame's width.
+	const std::vector<unsigned int>& getImage() const;
+
+protected:
+	// Size of a character of the system font, in pixels.
+	static const int CHARACTER_WIDTH = 8;
+	static const int CHARACTER_HEIGHT = 16;
+
+	void upload(const TiledBuffer<unsigned int>& colours, int lowTileX, int lowTileY,
+				int highTileX, int highTileY);
+	void measureOverlay(const std::string& text, int& width, int& height);
+	void drawOverlay(const std::string& text);
+	void show(int x, int y, int width, int height);
+
+private:
+	std::vector<unsigned int> m_image;
+};
+
+#endif // PRESENTER_H
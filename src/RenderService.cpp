@@ -0,0 +1,885 @@
+#include "RenderService.h"
+#include "Kernel.h"
+#include "TileOrder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+
+static const char* TUNING_PATH = "tuning.txt";
+static const char* KERNEL_NAMES[RenderRequest::MODE_COUNT] = { "escape-time", "distance" };
+
+// Starting parameters, before anything has been measured on this machine.
+static const double DEFAULT_ITERATIONS_PER_MILLISECOND = 100000.0;
+static const double DEFAULT_UNIT_MILLISECONDS = 2.0;
+
+// Bounds on a unit's time. The upper bound also bounds how long an
+// interactive task can wait behind a batch unit.
+static const double MIN_UNIT_MILLISECONDS = 0.25;
+static const double MAX_UNIT_MILLISECONDS = 8.0;
+
+// Units are made smaller when more than STEAL_HIGH of them were run on a
+// node other than the one they were queued for, and larger when fewer than
+// STEAL_LOW were, by UNIT_STEP each time.
+static const double STEAL_HIGH = 0.2;
+static const double STEAL_LOW = 0.02;
+static const double UNIT_STEP = 1.25;
+
+// Weight of the newest measurement of the kernel's speed.
+static const double RATE_SMOOTHING = 0.5;
+
+// Jobs with fewer units than this many per active worker say little about
+// the worker count, and are not used to tune it.
+static const int UNITS_PER_WORKER = 4;
+
+struct Unit
+{
+	// Tile coordinates of the unit's top left tile, and its size in tiles.
+	int x, y, size;
+
+	// Estimated iterations.
+	double cost;
+};
+
+struct RenderJob::State
+{
+	RenderRequest request;
+	PackedTiles result;
+
+	int tileCount;
+
+	// Units in the order they are handed out, from the middle of the image.
+	std::vector<Unit> units;
+
+	// Next unit to hand out, the job's place in the submission order and
+	// its pass, guarded by the service's mutex. Each tile handed out moves
+	// the pass on by 1 / weight, and the job with the lowest pass goes next.
+	int nextUnit;
+	int sequence;
+	double pass;
+
+	// The active worker count when the first unit was taken, and the
+	// estimated iterations and run time of the units rendered, not counting
+	// time spent queued. Also guarded by the service's mutex.
+	int activeWorkers;
+	double estimatedIterations;
+	double milliseconds;
+
+	std::atomic<int> priority;
+	std::atomic<bool> cancelled;
+
+	// The rest is guarded by the job's own mutex.
+	std::mutex mutex;
+	std::condition_variable finished;
+	Status status;
+
+	// Tiles rendered, and tiles rendered or skipped whose progress
+	// callbacks have returned.
+	int tilesDone;
+	int tilesFinished;
+	std::vector<std::function<void(const RenderJob&)> > continuations;
+};
+
+
+bool RenderJob::isValid() const
+{
+	return m_state != nullptr;
+}
+
+
+void RenderJob::wait() const
+{
+	if (!m_state)
+		return;
+
+	std::unique_lock<std::mutex> lock(m_state->mutex);
+
+	m_state->finished.wait(lock, [this] { return m_state->status == COMPLETE || m_state->status == CANCELLED; });
+}
+
+
+bool RenderJob::waitFor(int milliseconds) const
+{
+	if (!m_state)
+		return true;
+
+	std::unique_lock<std::mutex> lock(m_state->mutex);
+
+	return m_state->finished.wait_for(lock, std::chrono::milliseconds(milliseconds),
+		[this] { return m_state->status == COMPLETE || m_state->status == CANCELLED; });
+}
+
+
+void RenderJob::then(std::function<void(const RenderJob& job)> continuation) const
+{
+	if (!m_state)
+	{
+		continuation(*this);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_state->mutex);
+
+	if (m_state->status != COMPLETE && m_state->status != CANCELLED)
+	{
+		m_state->continuations.push_back(continuation);
+		return;
+	}
+
+	lock.unlock();
+	continuation(*this);
+}
+
+
+void RenderJob::cancel() const
+{
+	if (m_state)
+		m_state->cancelled = true;
+}
+
+
+// Takes effect from the job's next tile.
+void RenderJob::setPriority(int priority) const
+{
+	if (m_state)
+		m_state->priority = priority;
+}
+
+
+RenderJob::Status RenderJob::getStatus() const
+{
+	if (!m_state)
+		return CANCELLED;
+
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+	return m_state->status;
+}
+
+
+int RenderJob::getTilesDone() const
+{
+	if (!m_state)
+		return 0;
+
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+	return m_state->tilesDone;
+}
+
+
+int RenderJob::getTileCount() const
+{
+	return m_state ? m_state->tileCount : 0;
+}
+
+
+const RenderRequest& RenderJob::getRequest() const
+{
+	static const RenderRequest noRequest = RenderRequest();
+	return m_state ? m_state->request : noRequest;
+}
+
+
+const PackedTiles& RenderJob::getResult() const
+{
+	static const PackedTiles noResult;
+	return m_state ? m_state->result : noResult;
+}
+
+
+RenderService::RenderService() : m_pool(&m_ownPool), m_accepting(false)
+{
+	init();
+}
+
+
+RenderService::RenderService(WorkerPool* pool) : m_pool(pool), m_accepting(true)
+{
+	init();
+}
+
+
+RenderService::~RenderService()
+{
+	stop();
+}
+
+
+void RenderService::init()
+{
+	m_sequence = 0;
+
+	for (int priorityClass = 0; priorityClass < WorkerPool::PRIORITY_COUNT; ++priorityClass)
+	{
+		m_unitsLeft[priorityClass] = 0;
+		m_tasksQueued[priorityClass] = 0;
+		m_tasksRunning[priorityClass] = 0;
+	}
+
+	loadTuning();
+}
+
+
+void RenderService::start(const WorkerPool::Config& config)
+{
+	m_ownPool.start(config);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_accepting = true;
+}
+
+
+// Queued units of cancelled jobs are skipped, so the workers finish quickly.
+void RenderService::stop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_accepting = false;
+
+	for (int priorityClass = 0; priorityClass < WorkerPool::PRIORITY_COUNT; ++priorityClass)
+	{
+		for (std::vector<std::shared_ptr<RenderJob::State> >::iterator iter = m_jobs[priorityClass].begin();
+			iter != m_jobs[priorityClass].end(); ++iter)
+		{
+			(*iter)->cancelled = true;
+		}
+	}
+
+	m_drained.wait(lock, [this] { return isDrained(); });
+	saveTuning();
+	lock.unlock();
+
+	// The last task may still be returning to its worker, which counts it
+	// off in m_tasks, so the service must not be destroyed before then
+	m_pool->wait(m_tasks);
+
+	if (m_pool == &m_ownPool)
+		m_ownPool.stop();
+}
+
+
+// Starts from the parameters last saved for this machine, or the defaults.
+void RenderService::loadTuning()
+{
+	for (int mode = 0; mode < RenderRequest::MODE_COUNT; ++mode)
+	{
+		KernelTuning& tuning = m_tuning[mode];
+		tuning.parameters.iterationsPerMillisecond = DEFAULT_ITERATIONS_PER_MILLISECOND;
+		tuning.parameters.unitMilliseconds = DEFAULT_UNIT_MILLISECONDS;
+		tuning.parameters.activeWorkers = 0;
+		tuning.changed = false;
+		tuning.estimatedIterations = 0.0;
+		tuning.milliseconds = 0.0;
+		tuning.units = 0;
+		tuning.stealsAtStart = 0;
+		std::fill(tuning.baseThroughput, tuning.baseThroughput + SIZE_CLASSES, 0.0);
+		tuning.trialWorkers = 0;
+		tuning.workerDirection = -1;
+
+		Tuning::load(TUNING_PATH, KERNEL_NAMES[mode], tuning.parameters);
+	}
+}
+
+
+// Call with m_mutex held.
+void RenderService::saveTuning()
+{
+	for (int mode = 0; mode < RenderRequest::MODE_COUNT; ++mode)
+	{
+		if (m_tuning[mode].changed && Tuning::save(TUNING_PATH, KERNEL_NAMES[mode], m_tuning[mode].parameters))
+			m_tuning[mode].changed = false;
+	}
+}
+
+
+Tuning::Parameters RenderService::getTuning(RenderRequest::Mode mode)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_tuning[mode].parameters;
+}
+
+
+// Queues the job's units, as far as the active worker count allows.
+// A task does not render a particular unit, it takes whichever is most
+// urgent when it runs.
+RenderJob RenderService::submit(const RenderRequest& request)
+{
+	std::shared_ptr<RenderJob::State> job = std::make_shared<RenderJob::State>();
+	job->request = request;
+	job->result.init(request.width, request.height);
+	job->tileCount = job->result.getTilesX() * job->result.getTilesY();
+	job->nextUnit = 0;
+	job->activeWorkers = 0;
+	job->estimatedIterations = 0.0;
+	job->milliseconds = 0.0;
+	job->priority = request.priority;
+	job->cancelled = false;
+	job->status = RenderJob::QUEUED;
+	job->tilesDone = 0;
+	job->tilesFinished = 0;
+
+	if (job->tileCount == 0)
+	{
+		job->status = RenderJob::COMPLETE;
+		return RenderJob(job);
+	}
+
+	planUnits(*job);
+
+	std::vector<std::shared_ptr<RenderJob::State> >& jobs = m_jobs[request.priorityClass];
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// No worker would ever take the job's units
+	if (!m_accepting)
+	{
+		std::lock_guard<std::mutex> jobLock(job->mutex);
+		job->cancelled = true;
+		job->status = RenderJob::CANCELLED;
+		return RenderJob(job);
+	}
+
+	job->sequence = m_sequence++;
+
+	// A new job starts level with the jobs it shares the workers with,
+	// rather than owed every tile they have had so far
+	job->pass = 0.0;
+
+	for (std::vector<std::shared_ptr<RenderJob::State> >::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+		job->pass = iter == jobs.begin() ? (*iter)->pass : std::min(job->pass, (*iter)->pass);
+
+	jobs.push_back(job);
+	m_unitsLeft[request.priorityClass] += (int) job->units.size();
+	fillPipeline(request.priorityClass);
+
+	return RenderJob(job);
+}
+
+
+int RenderService::getWorkerCount()
+{
+	return m_pool->getWorkerCount();
+}
+
+
+// Estimates each tile's iterations from its centre point.
+// Points in the main bulbs are known to take the whole limit.
+std::vector<double> RenderService::probeTiles(const RenderJob::State& job)
+{
+	const RenderRequest& request = job.request;
+	const View& view = request.view;
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+	const int tilesX = job.result.getTilesX();
+	const int tilesY = job.result.getTilesY();
+
+	std::vector<double> costs(tilesX * tilesY);
+
+	for (int tileY = 0; tileY < tilesY; ++tileY)
+	{
+		const double y = std::min(tileY * tileSize + tileSize / 2, request.height - 1);
+
+		for (int tileX = 0; tileX < tilesX; ++tileX)
+		{
+			const double x = std::min(tileX * tileSize + tileSize / 2, request.width - 1);
+			std::complex<double> c(view.left + (x * (view.right - view.left) / request.width),
+				view.top + (y * (view.bottom - view.top) / request.height));
+			std::complex<double> z;
+
+			const int iterations = Kernel::isInMainBulbs(c) ? view.maxIterations :
+				Kernel::escapeTime(c, view.maxIterations, z);
+
+			costs[tileY * tilesX + tileX] = (double) std::max(iterations, 1) * TiledBuffer<float>::TILE_AREA;
+		}
+	}
+
+	return costs;
+}
+
+
+// Splits the job into units that should each take about the kernel's
+// tuned unit time. Each block of tiles becomes one unit if it is cheap
+// enough, else each of its quarters does, and the quarters that are
+// still too expensive are split into single tiles.
+void RenderService::planUnits(RenderJob::State& job)
+{
+	const int tilesX = job.result.getTilesX();
+	const int tilesY = job.result.getTilesY();
+	const std::vector<double> costs = probeTiles(job);
+
+	m_mutex.lock();
+	const Tuning::Parameters& parameters = m_tuning[job.request.mode].parameters;
+	const double budget = parameters.iterationsPerMillisecond * parameters.unitMilliseconds;
+	m_mutex.unlock();
+
+	// Returns the estimated cost of the square of tiles at x, y, clipped to the job.
+	auto squareCost = [&](int x, int y, int size)
+	{
+		double cost = 0.0;
+
+		for (int tileY = y; tileY < std::min(y + size, tilesY); ++tileY)
+		{
+			for (int tileX = x; tileX < std::min(x + size, tilesX); ++tileX)
+				cost += costs[tileY * tilesX + tileX];
+		}
+
+		return cost;
+	};
+
+	const int blocksX = (tilesX + UNIT_BLOCK - 1) / UNIT_BLOCK;
+	const int blocksY = (tilesY + UNIT_BLOCK - 1) / UNIT_BLOCK;
+	const std::vector<TileOrder::Tile> blocks = TileOrder::order(TileOrder::SPIRAL, 0, 0, blocksX, blocksY,
+		blocksX / 2, blocksY / 2);
+
+	for (std::vector<TileOrder::Tile>::const_iterator block = blocks.begin(); block != blocks.end(); ++block)
+	{
+		Unit unit;
+		unit.x = block->x * UNIT_BLOCK;
+		unit.y = block->y * UNIT_BLOCK;
+		unit.size = UNIT_BLOCK;
+		unit.cost = squareCost(unit.x, unit.y, UNIT_BLOCK);
+
+		if (unit.cost <= budget)
+		{
+			job.units.push_back(unit);
+			continue;
+		}
+
+		const int half = UNIT_BLOCK / 2;
+
+		for (int quarter = 0; quarter < 4; ++quarter)
+		{
+			Unit part;
+			part.x = unit.x + (quarter % 2) * half;
+			part.y = unit.y + (quarter / 2) * half;
+			part.size = half;
+
+			if (part.x >= tilesX || part.y >= tilesY)
+				continue;
+
+			part.cost = squareCost(part.x, part.y, half);
+
+			if (part.cost <= budget)
+			{
+				job.units.push_back(part);
+				continue;
+			}
+
+			for (int tile = 0; tile < half * half; ++tile)
+			{
+				Unit single;
+				single.x = part.x + tile % half;
+				single.y = part.y + tile / half;
+				single.size = 1;
+
+				if (single.x >= tilesX || single.y >= tilesY)
+					continue;
+
+				single.cost = costs[single.y * tilesX + single.x];
+				job.units.push_back(single);
+			}
+		}
+	}
+}
+
+
+// Returns the most urgent job in a pool class with units left, or the
+// end of the class's jobs if there are none. Cancelled jobs go first, as
+// their units only need counting off. Call with m_mutex held.
+std::vector<std::shared_ptr<RenderJob::State> >::iterator RenderService::findNextJob(WorkerPool::Priority priorityClass)
+{
+	std::vector<std::shared_ptr<RenderJob::State> >& jobs = m_jobs[priorityClass];
+	std::vector<std::shared_ptr<RenderJob::State> >::iterator best = jobs.end();
+
+	for (std::vector<std::shared_ptr<RenderJob::State> >::iterator iter = jobs.begin();
+		iter != jobs.end(); ++iter)
+	{
+		if (best == jobs.end())
+		{
+			best = iter;
+			continue;
+		}
+
+		const bool cancelled = (*iter)->cancelled;
+		const bool bestCancelled = (*best)->cancelled;
+		const int priority = (*iter)->priority;
+		const int bestPriority = (*best)->priority;
+
+		if (cancelled != bestCancelled ? cancelled :
+			priority != bestPriority ? priority > bestPriority :
+			(*iter)->pass != (*best)->pass ? (*iter)->pass < (*best)->pass : (*iter)->sequence < (*best)->sequence)
+		{
+			best = iter;
+		}
+	}
+
+	return best;
+}
+
+
+// Returns how many units of a kernel to keep in flight, the count on
+// trial if there is one. Call with m_mutex held.
+int RenderService::getActiveWorkers(RenderRequest::Mode mode)
+{
+	const int workers = std::max(m_pool->getWorkerCount(), 1);
+	const int active = m_tuning[mode].trialWorkers > 0 ? m_tuning[mode].trialWorkers : m_tuning[mode].parameters.activeWorkers;
+
+	return active > 0 ? std::min(active, workers) : workers;
+}
+
+
+// The whole part of the log2 of a tile count, capped at the last size class.
+int RenderService::getSizeClass(int tileCount)
+{
+	int sizeClass = 0;
+
+	for (; tileCount > 1 && sizeClass < SIZE_CLASSES - 1; tileCount /= 2)
+		++sizeClass;
+
+	return sizeClass;
+}
+
+
+// Queues tasks for a pool class's units, keeping no more in flight than
+// the active worker count of the most urgent job's kernel. Call with m_mutex held.
+void RenderService::fillPipeline(WorkerPool::Priority priorityClass)
+{
+	while (m_tasksQueued[priorityClass] < m_unitsLeft[priorityClass])
+	{
+		std::vector<std::shared_ptr<RenderJob::State> >::iterator next = findNextJob(priorityClass);
+		const int limit = getActiveWorkers((*next)->request.mode);
+
+		if (m_tasksQueued[priorityClass] + m_tasksRunning[priorityClass] >= limit)
+			break;
+
+		const int node = (m_tasksQueued[priorityClass] + m_tasksRunning[priorityClass]) % m_pool->getNodeCount();
+		++m_tasksQueued[priorityClass];
+		m_pool->submit(node, priorityClass, m_tasks, std::bind(&RenderService::runUnit, this, priorityClass));
+	}
+}
+
+
+// Call with m_mutex held.
+bool RenderService::isDrained()
+{
+	for (int priorityClass = 0; priorityClass < WorkerPool::PRIORITY_COUNT; ++priorityClass)
+	{
+		if (m_unitsLeft[priorityClass] > 0 || m_tasksQueued[priorityClass] > 0 || m_tasksRunning[priorityClass] > 0)
+			return false;
+	}
+
+	return true;
+}
+
+
+// Takes the next unit of the most urgent job in a pool class and renders it,
+// timing it for the kernel's tuning. Each unit is a point where a worker
+// can turn to more urgent work.
+void RenderService::runUnit(WorkerPool::Priority priorityClass)
+{
+	m_mutex.lock();
+
+	--m_tasksQueued[priorityClass];
+	++m_tasksRunning[priorityClass];
+	--m_unitsLeft[priorityClass];
+
+	std::vector<std::shared_ptr<RenderJob::State> >::iterator best = findNextJob(priorityClass);
+	std::shared_ptr<RenderJob::State> job = *best;
+	const Unit unit = job->units[job->nextUnit];
+
+	if (job->nextUnit++ == 0)
+	{
+		job->activeWorkers = getActiveWorkers(job->request.mode);
+
+		if (m_tuning[job->request.mode].units == 0)
+			m_tuning[job->request.mode].stealsAtStart = m_pool->getStealCount();
+	}
+
+	const int tilesX = job->result.getTilesX();
+	const int tilesY = job->result.getTilesY();
+	const int highX = std::min(unit.x + unit.size, tilesX);
+	const int highY = std::min(unit.y + unit.size, tilesY);
+	job->pass += (double) ((highX - unit.x) * (highY - unit.y)) / std::max(job->request.weight, 0.001);
+
+	if (job->nextUnit == (int) job->units.size())
+		m_jobs[priorityClass].erase(best);
+
+	m_mutex.unlock();
+
+	if (!job->cancelled)
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+
+		if (job->status == RenderJob::QUEUED)
+			job->status = RenderJob::RUNNING;
+	}
+
+	const std::chrono::steady_clock::time_point unitStart = std::chrono::steady_clock::now();
+	std::vector<bool> rendered;
+
+	for (int tileY = unit.y; tileY < highY; ++tileY)
+	{
+		for (int tileX = unit.x; tileX < highX; ++tileX)
+			rendered.push_back(!job->cancelled && renderTile(*job, tileX, tileY));
+	}
+
+	const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - unitStart).count();
+
+	if (rendered.back())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		KernelTuning& tuning = m_tuning[job->request.mode];
+		tuning.estimatedIterations += unit.cost;
+		tuning.milliseconds += milliseconds;
+		++tuning.units;
+		job->estimatedIterations += unit.cost;
+		job->milliseconds += milliseconds;
+	}
+
+	for (int tileY = unit.y, index = 0; tileY < highY; ++tileY)
+	{
+		for (int tileX = unit.x; tileX < highX; ++tileX)
+			finishTile(job, tileX, tileY, rendered[index++]);
+	}
+
+	// Notified under the lock, as stop() can return, and the service be
+	// destroyed, as soon as it sees the service drained
+	std::lock_guard<std::mutex> lock(m_mutex);
+	--m_tasksRunning[priorityClass];
+	fillPipeline(priorityClass);
+
+	if (isDrained())
+		m_drained.notify_all();
+}
+
+
+// Fills in one tile of the job's result, checking for cancellation between rows.
+// The tile is rendered in full, then packed into the result.
+// Returns false if the job was cancelled before the tile was complete.
+bool RenderService::renderTile(RenderJob::State& job, int tileX, int tileY)
+{
+	const RenderRequest& request = job.request;
+	const View& view = request.view;
+	const int tileSize = TiledBuffer<float>::TILE_SIZE;
+	const double width = (double) request.width;
+	const double height = (double) request.height;
+	const double spacing = (view.right - view.left) / width;
+	const bool fixedPoint = request.mode == RenderRequest::ESCAPE_TIME &&
+		Kernel::fixedPointCovers(view.left, view.right, view.top, view.bottom,
+			std::min(fabs(spacing), fabs((view.bottom - view.top) / height)));
+
+	float tile[TiledBuffer<float>::TILE_AREA];
+	const int lowX = tileX * tileSize;
+	const int lowY = tileY * tileSize;
+	const int columns = std::min(tileSize, request.width - lowX);
+	const int rows = std::min(tileSize, request.height - lowY);
+
+	for (int row = 0; row < rows; ++row)
+	{
+		if (job.cancelled)
+			return false;
+
+		const double imag = view.top + ((lowY + row) * (view.bottom - view.top) / height);
+		float* values = &tile[row * tileSize];
+
+		if (request.mode == RenderRequest::DISTANCE)
+		{
+			// The distance kernel takes points in pairs
+			for (int column = 0; column < columns; column += 2)
+			{
+				const int second = std::min(column + 1, columns - 1);
+				const double real[2] = {
+					view.left + ((lowX + column) * (view.right - view.left) / width),
+					view.left + ((lowX + second) * (view.right - view.left) / width)
+				};
+				const double imags[2] = { imag, imag };
+
+				double distances[2];
+				Kernel::estimateDistances(real, imags, view.maxIterations, distances);
+
+				values[column] = Kernel::distanceShade(distances[0], spacing, view.maxIterations);
+				values[second] = Kernel::distanceShade(distances[1], spacing, view.maxIterations);
+			}
+
+			continue;
+		}
+
+		if (fixedPoint)
+		{
+			// The fixed-point kernel also takes points in pairs. Its escape
+			// times do not depend on the machine, so tiles rendered by
+			// different services meet without seams.
+			for (int column = 0; column < columns; column += 2)
+			{
+				const int second = std::min(column + 1, columns - 1);
+				const std::complex<double> first(view.left + ((lowX + column) * (view.right - view.left) / width), imag);
+				const std::complex<double> partner(view.left + ((lowX + second) * (view.right - view.left) / width), imag);
+				const bool firstInside = Kernel::isInMainBulbs(first);
+				const bool partnerInside = Kernel::isInMainBulbs(partner);
+
+				float pair[2] = { (float) view.maxIterations, (float) view.maxIterations };
+
+				if (!firstInside || !partnerInside)
+				{
+					const double real[2] = { first.real(), partner.real() };
+					const double imags[2] = { imag, imag };
+					Kernel::sampleEscapeTimesFixed(real, imags, view.maxIterations, request.smooth, pair);
+				}
+
+				values[column] = firstInside ? (float) view.maxIterations : pair[0];
+				values[second] = partnerInside ? (float) view.maxIterations : pair[1];
+			}
+
+			continue;
+		}
+
+		for (int column = 0; column < columns; ++column)
+		{
+			std::complex<double> c(view.left + ((lowX + column) * (view.right - view.left) / width), imag);
+
+			values[column] = Kernel::isInMainBulbs(c) ? (float) view.maxIterations :
+				Kernel::sampleEscapeTime(c, view.maxIterations, request.smooth);
+		}
+	}
+
+	job.result.packTile(tileX, tileY, tile);
+
+	return true;
+}
+
+
+// Counts a tile off, reports it if it was rendered, and finishes the job
+// once every tile's callback has returned, so continuations always run last.
+// The job is CANCELLED if any of its tiles were skipped.
+void RenderService::finishTile(const std::shared_ptr<RenderJob::State>& job, int tileX, int tileY, bool rendered)
+{
+	int tilesDone = 0;
+
+	if (rendered)
+	{
+		job->mutex.lock();
+		tilesDone = ++job->tilesDone;
+		job->mutex.unlock();
+	}
+
+	if (rendered && job->request.onTile)
+		job->request.onTile(RenderJob(job), tileX, tileY, tilesDone);
+
+	std::vector<std::function<void(const RenderJob&)> > continuations;
+
+	job->mutex.lock();
+
+	if (++job->tilesFinished < job->tileCount)
+	{
+		job->mutex.unlock();
+		return;
+	}
+
+	job->status = job->tilesDone == job->tileCount ? RenderJob::COMPLETE : RenderJob::CANCELLED;
+	continuations.swap(job->continuations);
+	job->mutex.unlock();
+
+	if (job->status == RenderJob::COMPLETE)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		updateTuning(*job);
+	}
+
+	job->finished.notify_all();
+
+	for (std::vector<std::function<void(const RenderJob&)> >::iterator iter = continuations.begin();
+		iter != continuations.end(); ++iter)
+	{
+		(*iter)(RenderJob(job));
+	}
+}
+
+
+// Retunes the job's kernel from what has been measured since it last changed.
+// - The kernel's speed is how many estimated iterations a worker got through
+//   per millisecond, so that units planned from it take the intended time.
+// - With more than one node, if many units were stolen, nodes ran out of
+//   work while others had plenty queued, so units are made smaller to spread
+//   the work more evenly. If hardly any were, they are made larger to cut
+//   the scheduling overhead. A single node has nothing to steal from.
+// - The active worker count is hill climbed one step at a time, in case
+//   memory or other processes mean fewer workers get more done. A job's
+//   throughput is its workers times the estimated iterations per millisecond
+//   its units ran at, so time spent queued behind other jobs does not count.
+//   Each job at the saved count is averaged into the baseline for its size,
+//   and the next job tries a step away. The step is kept if that job beat
+//   the baseline for its size, otherwise the next trial goes the other way.
+//   Either way the job after it runs at the saved count again.
+// Call with m_mutex held.
+void RenderService::updateTuning(RenderJob::State& job)
+{
+	KernelTuning& tuning = m_tuning[job.request.mode];
+	Tuning::Parameters& parameters = tuning.parameters;
+	const int workers = getActiveWorkers(job.request.mode);
+
+	if (tuning.units < workers * UNITS_PER_WORKER || tuning.milliseconds <= 0.0)
+		return;
+
+	const double rate = tuning.estimatedIterations / tuning.milliseconds;
+	parameters.iterationsPerMillisecond = parameters.iterationsPerMillisecond * (1.0 - RATE_SMOOTHING) + rate * RATE_SMOOTHING;
+
+	if (m_pool->getNodeCount() > 1)
+	{
+		const double stealRate = (double) std::max(m_pool->getStealCount() - tuning.stealsAtStart, 0) / (double) tuning.units;
+
+		if (stealRate > STEAL_HIGH)
+			parameters.unitMilliseconds = std::max(parameters.unitMilliseconds / UNIT_STEP, MIN_UNIT_MILLISECONDS);
+		else if (stealRate < STEAL_LOW)
+			parameters.unitMilliseconds = std::min(parameters.unitMilliseconds * UNIT_STEP, MAX_UNIT_MILLISECONDS);
+	}
+
+	const int poolWorkers = std::max(m_pool->getWorkerCount(), 1);
+	const int kept = parameters.activeWorkers > 0 ? std::min(parameters.activeWorkers, poolWorkers) : poolWorkers;
+
+	// Jobs that started before the count last changed measured a different
+	// count, and are neither a baseline nor the trial
+	if ((int) job.units.size() >= job.activeWorkers * UNITS_PER_WORKER && job.milliseconds > 0.0)
+	{
+		const double throughput = job.activeWorkers * job.estimatedIterations / job.milliseconds;
+		double& baseThroughput = tuning.baseThroughput[getSizeClass(job.tileCount)];
+
+		if (tuning.trialWorkers == 0 && job.activeWorkers == kept)
+		{
+			baseThroughput = baseThroughput > 0.0 ?
+				baseThroughput * (1.0 - RATE_SMOOTHING) + throughput * RATE_SMOOTHING : throughput;
+
+			// Try a step from the kept count, turning round at the ends of the range
+			const int step = std::max(poolWorkers / 8, 1);
+			int trial = std::min(std::max(kept + step * tuning.workerDirection, 1), poolWorkers);
+
+			if (trial == kept)
+			{
+				tuning.workerDirection = -tuning.workerDirection;
+				trial = std::min(std::max(kept + step * tuning.workerDirection, 1), poolWorkers);
+			}
+
+			tuning.trialWorkers = trial != kept ? trial : 0;
+		}
+		else if (tuning.trialWorkers != 0 && job.activeWorkers == tuning.trialWorkers)
+		{
+			// Without a baseline of the trial's size the trial decides nothing
+			if (baseThroughput > 0.0 && throughput > baseThroughput)
+			{
+				// The baselines measured the old count
+				parameters.activeWorkers = tuning.trialWorkers;
+				std::fill(tuning.baseThroughput, tuning.baseThroughput + SIZE_CLASSES, 0.0);
+				baseThroughput = throughput;
+			}
+			else if (baseThroughput > 0.0)
+			{
+				tuning.workerDirection = -tuning.workerDirection;
+			}
+
+			tuning.trialWorkers = 0;
+		}
+	}
+
+	tuning.estimatedIterations = 0.0;
+	tuning.milliseconds = 0.0;
+	tuning.units = 0;
+	tuning.changed = true;
+}
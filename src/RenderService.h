@@ -0,0 +1,223 @@
+/* RenderService.h
+ *
+ * An embeddable renderer, independent of the viewer's window and threads.
+ * Each submitted request becomes a job, rendered tile by tile on the
+ * service's worker pool, which every job shares. A job's handle can be
+ * waited on or given continuations, reports each tile as it completes,
+ * and can be cancelled or reprioritised while it runs.
+ * Workers pick the next tile when they become free, so a job submitted
+ * with a higher priority overtakes the tiles of the jobs already queued,
+ * and jobs of equal priority share the workers in proportion to their weights.
+ * Work is handed out in units of one or more tiles, sized from a cheap probe
+ * of each tile's cost, so units are small around the set's boundary and
+ * large far outside it. How long a unit should take, the kernel's speed and
+ * how many units to keep in flight are tuned from each job's measurements
+ * and saved per machine and kernel.
+ * Each tile is packed into the job's result as it completes, so large
+ * renders keep a fraction of the memory full escape times would take.
+ * The service can run on its own pool or share another, such as the
+ * viewer's, with jobs queued in that pool's interactive or batch class. */
+
+#ifndef RENDERSERVICE_H
+#define RENDERSERVICE_H
+
+#include "PackedTiles.h"
+#include "Tuning.h"
+#include "View.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class RenderJob;
+
+struct RenderRequest
+{
+	enum Mode
+	{
+		ESCAPE_TIME,
+		DISTANCE,
+		MODE_COUNT
+	};
+
+	View view;
+	int width;
+	int height;
+	Mode mode;
+
+	// Smooths escape times into normalised iteration counts.
+	bool smooth;
+
+	// The pool class the job's tiles are queued in. Batch jobs only get
+	// the workers interactive work leaves idle.
+	WorkerPool::Priority priorityClass;
+
+	// Within a class, tiles of higher priority jobs are rendered first.
+	// Jobs of equal priority are given tiles in proportion to their weights.
+	int priority;
+	double weight;
+
+	// Called on a worker thread as each tile completes, with the number
+	// of tiles completed so far. May be empty.
+	std::function<void(const RenderJob& job, int tileX, int tileY, int tilesDone)> onTile;
+};
+
+// A handle to a submitted job. Copies share the same job.
+class RenderJob
+{
+public:
+	enum Status
+	{
+		QUEUED,
+		RUNNING,
+		COMPLETE,
+		CANCELLED
+	};
+
+	// A handle to no job, which behaves as a job cancelled before it had
+	// any tiles: waits return at once and continuations run straight away.
+	RenderJob() { }
+
+	bool isValid() const;
+
+	// Blocks until the job has completed or been cancelled.
+	// Must not be called from a job's own callbacks.
+	void wait() const;
+
+	// As wait(), but gives up after a number of milliseconds.
+	// Returns true if the job has finished.
+	bool waitFor(int milliseconds) const;
+
+	// Calls a function once the job has completed or been cancelled, on the
+	// worker that finished it, or straight away if the job has already finished.
+	void then(std::function<void(const RenderJob& job)> continuation) const;
+
+	// Stops the job at the next row. Tiles already complete are kept.
+	void cancel() const;
+	void setPriority(int priority) const;
+
+	Status getStatus() const;
+
+	// Tiles rendered so far. Tiles skipped because the job was cancelled
+	// are not counted.
+	int getTilesDone() const;
+	int getTileCount() const;
+
+	const RenderRequest& getRequest() const;
+
+	// The job's escape times, or distance shades, packed tile by tile.
+	// Tiles are only complete once reported, and all of them once the job is COMPLETE.
+	const PackedTiles& getResult() const;
+
+private:
+	friend class RenderService;
+	struct State;
+
+	explicit RenderJob(const std::shared_ptr<State>& state) : m_state(state) { }
+
+	std::shared_ptr<State> m_state;
+};
+
+class RenderService
+{
+public:
+	RenderService();
+
+	// Runs jobs on a pool that is already started and outlives the service.
+	explicit RenderService(WorkerPool* pool);
+
+	~RenderService();
+
+	// Starts the service's own pool. A service on its own pool only accepts
+	// jobs once started.
+	void start(const WorkerPool::Config& config);
+
+	// Cancels every unfinished job and waits for the workers to drop them,
+	// then saves the tuning. The service's own pool is stopped, a shared one carries on.
+	void stop();
+
+	// Jobs submitted before start() on the service's own pool, or after
+	// stop(), are returned already CANCELLED, with no tiles rendered.
+	RenderJob submit(const RenderRequest& request);
+
+	int getWorkerCount();
+	Tuning::Parameters getTuning(RenderRequest::Mode mode);
+
+private:
+	// Units are squares of 1, 2 or UNIT_BLOCK tiles a side, within blocks of
+	// UNIT_BLOCK x UNIT_BLOCK tiles.
+	static const int UNIT_BLOCK = 4;
+
+	// Jobs are compared with jobs of the same size class, the whole part of
+	// the log2 of their tile count.
+	static const int SIZE_CLASSES = 32;
+
+	// A kernel's tuning, and what has been measured since it last changed.
+	struct KernelTuning
+	{
+		Tuning::Parameters parameters;
+		bool changed;
+
+		double estimatedIterations;
+		double milliseconds;
+		int units;
+		int stealsAtStart;
+
+		// The active worker count is hill climbed on job throughput. Jobs
+		// at the saved count and jobs a step away from it take turns. The
+		// baseline is a moving average of the saved count's throughput for
+		// each size class, and a step is only kept, and saved, if a job run
+		// with it beats the baseline for its size. trialWorkers is the count
+		// on trial, or 0 while jobs run at the saved count.
+		double baseThroughput[SIZE_CLASSES];
+		int trialWorkers;
+		int workerDirection;
+	};
+
+	WorkerPool m_ownPool;
+	WorkerPool* m_pool;
+
+	// Whether submitted jobs are queued. Guarded by m_mutex.
+	bool m_accepting;
+
+	// Jobs with units that have not been taken yet, by pool class.
+	std::vector<std::shared_ptr<RenderJob::State> > m_jobs[WorkerPool::PRIORITY_COUNT];
+	std::mutex m_mutex;
+
+	// By pool class, units not yet taken, and tasks queued on the pool
+	// that have not started or have not finished.
+	int m_unitsLeft[WorkerPool::PRIORITY_COUNT];
+	int m_tasksQueued[WorkerPool::PRIORITY_COUNT];
+	int m_tasksRunning[WorkerPool::PRIORITY_COUNT];
+	std::condition_variable m_drained;
+
+	// The service's tasks on the pool, counted apart from other submitters'.
+	WorkerPool::TaskGroup m_tasks;
+	int m_sequence;
+
+	KernelTuning m_tuning[RenderRequest::MODE_COUNT];
+
+	void init();
+	void loadTuning();
+	void saveTuning();
+
+	std::vector<double> probeTiles(const RenderJob::State& job);
+	void planUnits(RenderJob::State& job);
+
+	std::vector<std::shared_ptr<RenderJob::State> >::iterator findNextJob(WorkerPool::Priority priorityClass);
+	int getActiveWorkers(RenderRequest::Mode mode);
+	static int getSizeClass(int tileCount);
+	void fillPipeline(WorkerPool::Priority priorityClass);
+	bool isDrained();
+
+	void runUnit(WorkerPool::Priority priorityClass);
+	bool renderTile(RenderJob::State& job, int tileX, int tileY);
+	void finishTile(const std::shared_ptr<RenderJob::State>& job, int tileX, int tileY, bool rendered);
+	void updateTuning(RenderJob::State& job);
+};
+
+#endif // RENDERSERVICE_H
@@ -44,9 +44,9 @@ void Renderer::init()
 	m_bitmapInfo.bmiHeader.biWidth = m_frameWidth;
 	m_bitmapInfo.bmiHeader.biHeight = -m_frameHeight;
 	m_bitmapInfo.bmiHeader.biPlanes = 1;
-	m_bitmapInfo.bmiHeader.biBitCount = 24; // 24 bits per pixel - one unsigned char for each pixel
+	m_bitmapInfo.bmiHeader.biBitCount = 32; // 32 bits per pixel - blue, green, red and an unused byte
 	m_bitmapInfo.bmiHeader.biCompression = BI_RGB;
-	m_bitmapInfo.bmiHeader.biSizeImage = m_bitmapInfo.bmiHeader.biWidth * m_bitmapInfo.bmiHeader.biHeight;
+	m_bitmapInfo.bmiHeader.biSizeImage = m_frameWidth * m_frameHeight * 4;
 }
 
 
@@ -116,3 +116,11 @@ void Renderer::push()
 	// Clear the back buffer
 	FillRect(m_backHdc, &m_screenRect, (HBRUSH)GetStockObject(0));	
 }
+
+// Copies a rectangle of the back buffer to the front buffer. The back
+// buffer is left as it is, so it can be presented again a piece at a time.
+void Renderer::push(int x, int y, int width, int height)
+{
+	BitBlt(m_frontHdc, m_screenRect.left + x, m_screenRect.top + y,
+		   width, height, m_backHdc, x, y, SRCCOPY);
+}
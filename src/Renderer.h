@@ -26,6 +26,7 @@ public:
 	BITMAPINFO* getBitmapInfo();
 
 	void push();
+	void push(int x, int y, int width, int height);
 
 private:
 	// Width and height of a frame.
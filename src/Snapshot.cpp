@@ -0,0 +1,169 @@
+#include "Snapshot.h"
+#include "PackedTiles.h"
+
+#include "windows.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Snapshot
+{
+	static const unsigned int MAGIC = 0x5353424D; // "MBSS"
+	static const unsigned int VERSION = 2;
+
+	struct FileHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		int width;
+		int height;
+		Session session;
+
+		// Number of encoded bytes following the header.
+		unsigned int encodedBytes;
+	};
+
+	// Each tile is stored as its format in one byte, its base in four, then its payload.
+	static const unsigned int TILE_HEADER = 5;
+
+	static void encode(const TiledBuffer<float>& data, std::vector<unsigned char>& encoded)
+	{
+		const int tileSize = TiledBuffer<float>::TILE_SIZE;
+		unsigned char payload[PackedTiles::MAX_PAYLOAD];
+
+		for (int tileY = 0; tileY < data.getTilesY(); ++tileY)
+		{
+			for (int tileX = 0; tileX < data.getTilesX(); ++tileX)
+			{
+				int base;
+				const PackedTiles::Format format = PackedTiles::encodeTile(data.getTile(tileX, tileY),
+					std::min(tileSize, data.getWidth() - tileX * tileSize),
+					std::min(tileSize, data.getHeight() - tileY * tileSize), base, payload);
+
+				const size_t offset = encoded.size();
+				encoded.resize(offset + TILE_HEADER + PackedTiles::getPayloadSize(format));
+				encoded[offset] = (unsigned char) format;
+				memcpy(&encoded[offset + 1], &base, sizeof(base));
+				memcpy(&encoded[offset + TILE_HEADER], payload, PackedTiles::getPayloadSize(format));
+			}
+		}
+	}
+
+	// Returns false if the encoded bytes do not hold exactly one tile for
+	// each tile of the buffer.
+	static bool decode(const unsigned char* encoded, unsigned int encodedBytes, TiledBuffer<float>& data)
+	{
+		unsigned int in = 0;
+
+		for (int tileY = 0; tileY < data.getTilesY(); ++tileY)
+		{
+			for (int tileX = 0; tileX < data.getTilesX(); ++tileX)
+			{
+				if (encodedBytes - in < TILE_HEADER || encoded[in] >= PackedTiles::FORMAT_COUNT)
+					return false;
+
+				const PackedTiles::Format format = (PackedTiles::Format) encoded[in];
+				const unsigned int payloadSize = (unsigned int) PackedTiles::getPayloadSize(format);
+				int base;
+				memcpy(&base, &encoded[in + 1], sizeof(base));
+				in += TILE_HEADER;
+
+				if (encodedBytes - in < payloadSize)
+					return false;
+
+				PackedTiles::decodeTile(format, base, &encoded[in], data.getTile(tileX, tileY));
+				in += payloadSize;
+			}
+		}
+
+		return in == encodedBytes;
+	}
+
+
+	// The snapshot is written to a temporary file first, so an interrupted
+	// save never leaves a truncated snapshot behind.
+	bool save(const char* path, const Session& session, const TiledBuffer<float>& data)
+	{
+		std::vector<unsigned char> encoded;
+		encode(data, encoded);
+
+		FileHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.width = data.getWidth();
+		header.height = data.getHeight();
+		header.session = session;
+		header.encodedBytes = (unsigned int) encoded.size();
+
+		const std::string temporaryPath = std::string(path) + ".tmp";
+		std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+
+		if (!file)
+			return false;
+
+		file.write((const char*) &header, sizeof(header));
+		file.write((const char*) encoded.data(), encoded.size());
+		file.close();
+
+		if (!file)
+			return false;
+
+		// Replacing the old snapshot in one step leaves no moment without one
+		return MoveFileExA(temporaryPath.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	}
+
+
+	bool load(const char* path, Session& session, TiledBuffer<float>& data)
+	{
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG) sizeof(FileHeader))
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (mapping == nullptr)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		const unsigned char* mapped = (const unsigned char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		bool loaded = false;
+
+		if (mapped != nullptr)
+		{
+			FileHeader header;
+			memcpy(&header, mapped, sizeof(header));
+
+			if (header.magic == MAGIC && header.version == VERSION &&
+				header.width == data.getWidth() && header.height == data.getHeight() &&
+				(LONGLONG) header.encodedBytes <= fileSize.QuadPart - (LONGLONG) sizeof(header))
+			{
+				loaded = decode(mapped + sizeof(header), header.encodedBytes, data);
+
+				if (loaded)
+					session = header.session;
+			}
+
+			UnmapViewOfFile(mapped);
+		}
+
+		CloseHandle(mapping);
+		CloseHandle(file);
+
+		return loaded;
+	}
+}
@@ -0,0 +1,47 @@
+/* Snapshot.h
+ *
+ * Compact binary snapshots of a viewing session: the exact view, the
+ * viewer's settings and the escape time buffer, so that a frame can be
+ * restored without computing it again. The buffer is stored tile by tile,
+ * each tile packed as PackedTiles packs it, so tiles of one value, such as
+ * the inside of the set and proven exterior tiles, take a few bytes, and
+ * the rest take 1, 2 or 4 bytes a pixel as their range needs.
+ * Snapshots are read through a memory mapping and decoded straight into
+ * the buffer. */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "TiledBuffer.h"
+#include "View.h"
+
+namespace Snapshot
+{
+	struct Session
+	{
+		// The frame's view, stored exactly, including its iteration limit.
+		View view;
+
+		// The iteration limit used when auto iterations are off.
+		int manualIterations;
+		int autoIterations;
+
+		double zoomFactor;
+		int renderMode;
+		int paletteIndex;
+
+		// Finest refinement step the buffer holds, or 0 once the frame
+		// has been completed and anti-aliased.
+		int refinementStep;
+	};
+
+	// Writes a snapshot, replacing any snapshot already at the path.
+	bool save(const char* path, const Session& session, const TiledBuffer<float>& data);
+
+	// Reads a snapshot into a buffer of the same size as the one saved.
+	// Returns false, leaving the buffer undefined if it got as far as
+	// decoding, when the file is missing, corrupt or a different size.
+	bool load(const char* path, Session& session, TiledBuffer<float>& data);
+}
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,136 @@
+#include "TileOrder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace TileOrder
+{
+	// Interleaves the bits of x and y into a Morton (Z-order) code.
+	static unsigned int mortonCode(unsigned int x, unsigned int y)
+	{
+		unsigned int code = 0;
+
+		for (int bit = 0; bit < 16; ++bit)
+		{
+			code |= ((x >> bit) & 1u) << (bit * 2);
+			code |= ((y >> bit) & 1u) << (bit * 2 + 1);
+		}
+
+		return code;
+	}
+
+	// Converts a distance along a Hilbert curve covering a side x side
+	// square into coordinates. side must be a power of two.
+	static void hilbertPoint(int side, int distance, int& x, int& y)
+	{
+		x = 0;
+		y = 0;
+
+		for (int scale = 1; scale < side; scale *= 2)
+		{
+			const int rx = 1 & (distance / 2);
+			const int ry = 1 & (distance ^ rx);
+
+			// Rotate the quadrant so the curve stays continuous.
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = scale - 1 - x;
+					y = scale - 1 - y;
+				}
+
+				std::swap(x, y);
+			}
+
+			x += scale * rx;
+			y += scale * ry;
+			distance /= 4;
+		}
+	}
+
+	std::vector<Tile> order(Ordering ordering, int lowX, int lowY, int highX, int highY,
+							int centreX, int centreY)
+	{
+		std::vector<Tile> tiles;
+
+		if (highX <= lowX || highY <= lowY)
+			return tiles;
+
+		tiles.reserve((highX - lowX) * (highY - lowY));
+
+		if (ordering == HILBERT)
+		{
+			// Walk a curve over the enclosing power of two square,
+			// skipping the points that fall outside the rectangle.
+			int side = 1;
+
+			while (side < highX - lowX || side < highY - lowY)
+				side *= 2;
+
+			for (int distance = 0; distance < side * side; ++distance)
+			{
+				Tile tile;
+				hilbertPoint(side, distance, tile.x, tile.y);
+				tile.x += lowX;
+				tile.y += lowY;
+
+				if (tile.x < highX && tile.y < highY)
+					tiles.push_back(tile);
+			}
+
+			return tiles;
+		}
+
+		for (int y = lowY; y < highY; ++y)
+		{
+			for (int x = lowX; x < highX; ++x)
+			{
+				Tile tile = { x, y };
+				tiles.push_back(tile);
+			}
+		}
+
+		if (ordering == MORTON)
+		{
+			std::sort(tiles.begin(), tiles.end(), [lowX, lowY](const Tile& a, const Tile& b) {
+				return mortonCode(a.x - lowX, a.y - lowY) < mortonCode(b.x - lowX, b.y - lowY);
+			});
+		}
+		else if (ordering == SPIRAL)
+		{
+			// Sort by square ring around the centre, then by angle
+			// within the ring, which traces a spiral outwards.
+			std::sort(tiles.begin(), tiles.end(), [centreX, centreY](const Tile& a, const Tile& b) {
+				const int ringA = std::max(abs(a.x - centreX), abs(a.y - centreY));
+				const int ringB = std::max(abs(b.x - centreX), abs(b.y - centreY));
+
+				if (ringA != ringB)
+					return ringA < ringB;
+
+				return atan2((double) (a.y - centreY), (double) (a.x - centreX)) <
+					atan2((double) (b.y - centreY), (double) (b.x - centreX));
+			});
+		}
+
+		return tiles;
+	}
+
+	const char* getName(Ordering ordering)
+	{
+		switch (ordering)
+		{
+		case ROW_MAJOR:
+			return "row-major";
+		case MORTON:
+			return "Morton";
+		case HILBERT:
+			return "Hilbert";
+		case SPIRAL:
+			return "spiral";
+		default:
+			return "unknown";
+		}
+	}
+}
@@ -0,0 +1,37 @@
+/* TileOrder.h
+ * 
+ * Traversal orders for walking a rectangle of tiles.
+ * The order decides both how well neighbouring work shares the cache
+ * and which parts of the image appear first. */
+
+#ifndef TILEORDER_H
+#define TILEORDER_H
+
+#include <vector>
+
+namespace TileOrder
+{
+	enum Ordering
+	{
+		ROW_MAJOR,
+		MORTON,
+		HILBERT,
+		SPIRAL,
+		ORDERING_COUNT
+	};
+
+	struct Tile
+	{
+		int x, y;
+	};
+
+	// Returns the tiles in [lowX, highX) x [lowY, highY) in the given order.
+	// SPIRAL walks outwards from the tile at centreX, centreY, which
+	// need not lie inside the rectangle.
+	std::vector<Tile> order(Ordering ordering, int lowX, int lowY, int highX, int highY,
+							int centreX, int centreY);
+
+	const char* getName(Ordering ordering);
+}
+
+#endif // TILEORDER_H
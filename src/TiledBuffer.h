@@ -0,0 +1,205 @@
+/* TiledBuffer.h
+ *
+ * A 2D buffer of 4 byte values stored as square tiles.
+ * Each row of a tile is exactly one 64 byte cache line, and tiles are
+ * stored one after another, so a thread that owns whole tiles never
+ * shares a cache line with its neighbours. Rows are 64 byte aligned,
+ * which allows aligned vector loads and stores. */
+
+#ifndef TILEDBUFFER_H
+#define TILEDBUFFER_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+template <typename T>
+class TiledBuffer
+{
+public:
+	// Width and height of a tile, in elements.
+	// TILE_SIZE * sizeof(T) must be one cache line.
+	static const int TILE_SIZE = 16;
+	static const int TILE_AREA = TILE_SIZE * TILE_SIZE;
+	static const int CACHE_LINE = 64;
+
+	TiledBuffer() : m_data(nullptr), m_width(0), m_height(0), m_tilesX(0), m_tilesY(0) { }
+	~TiledBuffer();
+
+	void init(int width, int height);
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	int getTilesX() const { return m_tilesX; }
+	int getTilesY() const { return m_tilesY; }
+
+	// Returns the element at pixel x, y.
+	T& at(int x, int y)
+	{
+		return m_data[((y / TILE_SIZE) * m_tilesX + (x / TILE_SIZE)) * TILE_AREA +
+			(y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE)];
+	}
+
+	const T& at(int x, int y) const
+	{
+		return m_data[((y / TILE_SIZE) * m_tilesX + (x / TILE_SIZE)) * TILE_AREA +
+			(y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE)];
+	}
+
+	// Returns the first element of a tile. Rows within the tile follow
+	// each other, TILE_SIZE elements apart.
+	T* getTile(int tileX, int tileY)
+	{
+		return &m_data[(tileY * m_tilesX + tileX) * TILE_AREA];
+	}
+
+	const T* getTile(int tileX, int tileY) const
+	{
+		return &m_data[(tileY * m_tilesX + tileX) * TILE_AREA];
+	}
+
+	void fill(T value);
+	void fillTiles(int lowTileX, int lowTileY, int highTileX, int highTileY, T value);
+	void copyFrom(const TiledBuffer<T>& other);
+	void toLinear(T* destination, int destinationStride) const;
+	void toLinear(T* destination, int destinationStride, int lowTileX, int lowTileY, int highTileX, int highTileY) const;
+
+private:
+	T* m_data;
+	int m_width, m_height;
+	int m_tilesX, m_tilesY;
+
+	// Cache-line aligned allocation, from the CRT's aligned heap on Windows
+	// and posix_memalign elsewhere, so the buffer builds on any platform.
+	static T* allocate(size_t count);
+	static void release(T* data);
+
+	// Not copyable, the buffer owns its allocation.
+	TiledBuffer(const TiledBuffer<T>&);
+	TiledBuffer<T>& operator=(const TiledBuffer<T>&);
+};
+
+
+template <typename T>
+TiledBuffer<T>::~TiledBuffer()
+{
+	if (m_data != nullptr)
+		release(m_data);
+}
+
+
+// Allocates the buffer. The edge tiles are padded out to a whole
+// tile, and the padding is never read back by toLinear().
+template <typename T>
+void TiledBuffer<T>::init(int width, int height)
+{
+	static_assert(TILE_SIZE * sizeof(T) == CACHE_LINE, "A tile row must be one cache line");
+
+	if (m_data != nullptr)
+		release(m_data);
+
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	m_data = allocate(m_tilesX * m_tilesY * TILE_AREA);
+}
+
+
+// Sets every element, including the padding, to a value.
+template <typename T>
+void TiledBuffer<T>::fill(T value)
+{
+	std::fill(m_data, m_data + m_tilesX * m_tilesY * TILE_AREA, value);
+}
+
+
+// Sets every element of a range of tiles to a value.
+// Filling tiles from the thread that owns them also places their
+// memory on that thread's NUMA node, as pages are allocated on first touch.
+template <typename T>
+void TiledBuffer<T>::fillTiles(int lowTileX, int lowTileY, int highTileX, int highTileY, T value)
+{
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			T* tile = getTile(tileX, tileY);
+			std::fill(tile, tile + TILE_AREA, value);
+		}
+	}
+}
+
+
+// Copies the contents of a buffer of the same size.
+template <typename T>
+void TiledBuffer<T>::copyFrom(const TiledBuffer<T>& other)
+{
+	memcpy(m_data, other.m_data, m_tilesX * m_tilesY * TILE_AREA * sizeof(T));
+}
+
+
+// Copies the buffer into a linear, row-major image.
+// The stride is in elements and must be at least the buffer width.
+template <typename T>
+void TiledBuffer<T>::toLinear(T* destination, int destinationStride) const
+{
+	toLinear(destination, destinationStride, 0, 0, m_tilesX, m_tilesY);
+}
+
+
+// Copies a range of tiles into the same place in a linear image of the
+// whole buffer, leaving the rest of the image as it was.
+template <typename T>
+void TiledBuffer<T>::toLinear(T* destination, int destinationStride, int lowTileX, int lowTileY,
+							  int highTileX, int highTileY) const
+{
+	const int tileSize = TILE_SIZE;
+
+	for (int tileY = lowTileY; tileY < highTileY; ++tileY)
+	{
+		const int rows = std::min(tileSize, m_height - tileY * tileSize);
+
+		for (int tileX = lowTileX; tileX < highTileX; ++tileX)
+		{
+			const int columns = std::min(tileSize, m_width - tileX * tileSize);
+			const T* tile = getTile(tileX, tileY);
+
+			for (int row = 0; row < rows; ++row)
+			{
+				memcpy(&destination[(tileY * TILE_SIZE + row) * destinationStride + tileX * TILE_SIZE],
+					&tile[row * TILE_SIZE], columns * sizeof(T));
+			}
+		}
+	}
+}
+
+
+template <typename T>
+T* TiledBuffer<T>::allocate(size_t count)
+{
+#ifdef _WIN32
+	return (T*) _aligned_malloc(count * sizeof(T), CACHE_LINE);
+#else
+	void* data = nullptr;
+	return posix_memalign(&data, CACHE_LINE, count * sizeof(T)) == 0 ? (T*) data : nullptr;
+#endif
+}
+
+
+template <typename T>
+void TiledBuffer<T>::release(T* data)
+{
+#ifdef _WIN32
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+#endif // TILEDBUFFER_H
@@ -0,0 +1,92 @@
+#include "Tuning.h"
+
+#include "windows.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace Tuning
+{
+	std::string getHostName()
+	{
+		char name[MAX_COMPUTERNAME_LENGTH + 1];
+		DWORD length = sizeof(name);
+
+		if (!GetComputerNameA(name, &length))
+			return "unknown";
+
+		return std::string(name, length);
+	}
+
+
+	bool load(const char* path, const char* kernel, Parameters& parameters)
+	{
+		std::ifstream file(path);
+		const std::string host = getHostName();
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string lineHost, lineKernel;
+			Parameters loaded;
+
+			if (!(fields >> lineHost >> lineKernel >> loaded.iterationsPerMillisecond >> loaded.unitMilliseconds >> loaded.activeWorkers))
+				continue;
+
+			if (lineHost == host && lineKernel == kernel && loaded.iterationsPerMillisecond > 0.0 &&
+				loaded.unitMilliseconds > 0.0 && loaded.activeWorkers >= 0)
+			{
+				parameters = loaded;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	// The file is rewritten through a temporary file, like snapshots,
+	// so an interrupted save keeps the old parameters.
+	bool save(const char* path, const char* kernel, const Parameters& parameters)
+	{
+		const std::string host = getHostName();
+		std::vector<std::string> lines;
+
+		{
+			std::ifstream file(path);
+			std::string line;
+
+			while (std::getline(file, line))
+			{
+				std::istringstream fields(line);
+				std::string lineHost, lineKernel;
+
+				if (fields >> lineHost >> lineKernel && !(lineHost == host && lineKernel == kernel))
+					lines.push_back(line);
+			}
+		}
+
+		std::ostringstream updated;
+		updated << host << " " << kernel << " " << parameters.iterationsPerMillisecond << " "
+			<< parameters.unitMilliseconds << " " << parameters.activeWorkers;
+		lines.push_back(updated.str());
+
+		const std::string temporaryPath = std::string(path) + ".tmp";
+		std::ofstream file(temporaryPath.c_str(), std::ios::trunc);
+
+		if (!file)
+			return false;
+
+		for (std::vector<std::string>::iterator iter = lines.begin(); iter != lines.end(); ++iter)
+			file << *iter << "\n";
+
+		file.close();
+
+		if (!file)
+			return false;
+
+		return MoveFileExA(temporaryPath.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	}
+}
@@ -0,0 +1,39 @@
+/* Tuning.h
+ *
+ * Scheduling parameters measured on one machine for one kernel, kept in a
+ * plain text file with one line per host and kernel, so that the next run
+ * on the same machine starts from what the last one learnt. */
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <string>
+
+namespace Tuning
+{
+	struct Parameters
+	{
+		// Estimated iterations the kernel gets through per millisecond on one worker.
+		double iterationsPerMillisecond;
+
+		// How long a unit of work should take. Units are made smaller when
+		// workers have to steal to stay busy, and larger when they do not.
+		double unitMilliseconds;
+
+		// Number of units kept in flight on the pool, or 0 for one per worker.
+		int activeWorkers;
+	};
+
+	// Returns this machine's name, which the file is keyed by.
+	std::string getHostName();
+
+	// Reads the parameters saved for this machine and a kernel.
+	// Returns false, leaving the parameters as they were, if there are none.
+	bool load(const char* path, const char* kernel, Parameters& parameters);
+
+	// Saves the parameters for this machine and a kernel, keeping the
+	// lines of every other machine and kernel.
+	bool save(const char* path, const char* kernel, const Parameters& parameters);
+}
+
+#endif // TUNING_H
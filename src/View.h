@@ -0,0 +1,24 @@
+/* View.h
+ * 
+ * Describes the region of the complex plane shown by a render,
+ * and the iteration limit it is computed with. */
+
+#ifndef VIEW_H
+#define VIEW_H
+
+struct View
+{
+	double left;
+	double right;
+	double top;
+	double bottom;
+	int maxIterations;
+
+	bool operator==(const View& other) const
+	{
+		return left == other.left && right == other.right && top == other.top &&
+			bottom == other.bottom && maxIterations == other.maxIterations;
+	}
+};
+
+#endif // VIEW_H
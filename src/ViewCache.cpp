@@ -0,0 +1,126 @@
+#include "ViewCache.h"
+
+#include <cmath>
+
+// How far, as a fraction of a pixel, a view's edges may be from a cached
+// view's and still match it. Far below anything visible.
+static const double MATCH_TOLERANCE = 0.01;
+
+ViewCache::~ViewCache()
+{
+	for (std::vector<Entry>::iterator iter = m_entries.begin();
+		iter != m_entries.end(); ++iter)
+	{
+		delete iter->data;
+	}
+}
+
+
+// Allocates the cache's buffers.
+void ViewCache::init(int capacity, int width, int height)
+{
+	m_entries.resize(capacity);
+	m_width = width;
+	m_height = height;
+
+	for (std::vector<Entry>::iterator iter = m_entries.begin();
+		iter != m_entries.end(); ++iter)
+	{
+		iter->data = new PackedTiles();
+		iter->data->init(width, height);
+		iter->refinementStep = 0;
+		iter->used = false;
+		iter->lastUse = 0;
+	}
+}
+
+
+// A view predicted by adding the last navigation step again is not
+// always the view the same input produces, as the sums round differently,
+// so edges only need to match to within MATCH_TOLERANCE of a pixel.
+// The iteration limit must match exactly.
+ViewCache::Entry* ViewCache::find(const View& view)
+{
+	const double toleranceX = MATCH_TOLERANCE * fabs(view.right - view.left) / m_width;
+	const double toleranceY = MATCH_TOLERANCE * fabs(view.bottom - view.top) / m_height;
+
+	for (std::vector<Entry>::iterator iter = m_entries.begin();
+		iter != m_entries.end(); ++iter)
+	{
+		if (iter->refinementStep != 0 && iter->view.maxIterations == view.maxIterations &&
+			fabs(iter->view.left - view.left) <= toleranceX && fabs(iter->view.right - view.right) <= toleranceX &&
+			fabs(iter->view.top - view.top) <= toleranceY && fabs(iter->view.bottom - view.bottom) <= toleranceY)
+		{
+			return &(*iter);
+		}
+	}
+
+	return nullptr;
+}
+
+
+ViewCache::Entry* ViewCache::acquire(const View& view)
+{
+	Entry* oldest = &m_entries[0];
+
+	for (std::vector<Entry>::iterator iter = m_entries.begin();
+		iter != m_entries.end(); ++iter)
+	{
+		if (iter->lastUse < oldest->lastUse)
+			oldest = &(*iter);
+	}
+
+	// A speculative render that was never shown was wasted work
+	if (oldest->refinementStep != 0 && !oldest->used)
+		++m_wasted;
+
+	oldest->view = view;
+	oldest->refinementStep = 0;
+	oldest->used = false;
+	oldest->lastUse = ++m_clock;
+	++m_renders;
+
+	return oldest;
+}
+
+
+void ViewCache::markUsed(Entry* entry)
+{
+	if (!entry->used)
+		++m_hits;
+
+	entry->used = true;
+	entry->lastUse = ++m_clock;
+}
+
+
+int ViewCache::getRenderCount()
+{
+	return m_renders;
+}
+
+
+int ViewCache::getHitCount()
+{
+	return m_hits;
+}
+
+
+int ViewCache::getWastedCount()
+{
+	return m_wasted;
+}
+
+
+size_t ViewCache::getStoredBytes()
+{
+	size_t bytes = 0;
+
+	for (std::vector<Entry>::iterator iter = m_entries.begin();
+		iter != m_entries.end(); ++iter)
+	{
+		bytes += iter->data->getStoredBytes();
+	}
+
+	return bytes;
+}
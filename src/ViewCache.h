@@ -0,0 +1,64 @@
+/* ViewCache.h
+ * 
+ * A small cache of escape time buffers for views that have not been
+ * asked for yet, filled speculatively while the viewer is idle.
+ * Entries are packed, so the cache holds several times as many views as
+ * full buffers would in the same memory.
+ * Keeps count of how many speculative renders were used and how many were wasted. */
+
+#ifndef VIEWCACHE_H
+#define VIEWCACHE_H
+
+#include "PackedTiles.h"
+#include "View.h"
+
+#include <vector>
+
+class ViewCache
+{
+public:
+	struct Entry
+	{
+		View view;
+		PackedTiles* data;
+
+		// Finest refinement step completed so far, or 0 if none.
+		int refinementStep;
+
+		bool used;
+		unsigned int lastUse;
+	};
+
+	ViewCache() : m_width(1), m_height(1), m_clock(0), m_renders(0), m_hits(0), m_wasted(0) { }
+	~ViewCache();
+
+	void init(int capacity, int width, int height);
+
+	// Returns the entry holding a view, to within a small fraction of a
+	// pixel, or nullptr if it is not cached.
+	Entry* find(const View& view);
+
+	// Returns an entry to render a view into, evicting the least recently used one.
+	Entry* acquire(const View& view);
+
+	// Marks an entry as used by a real frame.
+	void markUsed(Entry* entry);
+
+	int getRenderCount();
+	int getHitCount();
+	int getWastedCount();
+
+	// Bytes taken by the entries' escape times.
+	size_t getStoredBytes();
+
+private:
+	std::vector<Entry> m_entries;
+	int m_width, m_height;
+	unsigned int m_clock;
+
+	int m_renders;
+	int m_hits;
+	int m_wasted;
+};
+
+#endif // VIEWCACHE_H
@@ -0,0 +1,283 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+WorkerPool::WorkerPool() : m_stopping(false), m_steals(0), m_pinned(false)
+{
+	resetQueueLatency();
+}
+
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+
+// Returns the NUMA nodes of this machine and the processors on each.
+// Machines without NUMA support are reported as a single node.
+std::vector<WorkerPool::Node> WorkerPool::detectTopology()
+{
+	std::vector<Node> nodes;
+	unsigned long highestNode = 0;
+
+	if (GetNumaHighestNodeNumber(&highestNode))
+	{
+		for (unsigned long i = 0; i <= highestNode; ++i)
+		{
+			Node node;
+			node.id = (unsigned short) i;
+			memset(&node.affinity, 0, sizeof(node.affinity));
+
+			if (!GetNumaNodeProcessorMaskEx(node.id, &node.affinity) || node.affinity.Mask == 0)
+				continue;
+
+			// Count the processors in the node's mask.
+			node.processorCount = 0;
+
+			for (KAFFINITY mask = node.affinity.Mask; mask != 0; mask &= mask - 1)
+				++node.processorCount;
+
+			nodes.push_back(node);
+		}
+	}
+
+	if (nodes.empty())
+	{
+		Node node;
+		node.id = 0;
+		memset(&node.affinity, 0, sizeof(node.affinity));
+		node.processorCount = (int) std::thread::hardware_concurrency();
+
+		if (node.processorCount < 1)
+			node.processorCount = 1;
+
+		nodes.push_back(node);
+	}
+
+	return nodes;
+}
+
+
+// Starts the workers. Call stop() before starting again with a different config.
+void WorkerPool::start(const Config& config)
+{
+	m_nodes = detectTopology();
+
+	if (config.maxNodes > 0 && config.maxNodes < (int) m_nodes.size())
+		m_nodes.resize(config.maxNodes);
+
+	// Pinning needs a real processor mask, which the fallback node does not have.
+	m_pinned = config.pinThreads && m_nodes[0].affinity.Mask != 0;
+	m_stopping = false;
+	m_steals = 0;
+
+	for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+	{
+		m_queues[priority].clear();
+		m_queues[priority].resize(m_nodes.size());
+	}
+
+	for (int node = 0; node < (int) m_nodes.size(); ++node)
+	{
+		int workerCount = config.workersPerNode > 0 ? config.workersPerNode : m_nodes[node].processorCount;
+
+		for (int i = 0; i < workerCount; ++i)
+		{
+			Worker worker;
+			worker.node = node;
+			worker.thread = new std::thread(&WorkerPool::workerLoop, this, node);
+			m_workers.push_back(worker);
+		}
+	}
+}
+
+
+// Finishes the queued tasks and joins every worker.
+void WorkerPool::stop()
+{
+	m_mutex.lock();
+	m_stopping = true;
+	m_mutex.unlock();
+
+	m_workAvailable.notify_all();
+
+	for (std::vector<Worker>::iterator iter = m_workers.begin();
+		iter != m_workers.end(); ++iter)
+	{
+		iter->thread->join();
+		delete iter->thread;
+	}
+
+	m_workers.clear();
+}
+
+
+void WorkerPool::submit(int node, Priority priority, TaskGroup& group, std::function<void()> task)
+{
+	Task queued;
+	queued.run = task;
+	queued.group = &group;
+	queued.queued = std::chrono::steady_clock::now();
+
+	m_mutex.lock();
+	m_queues[priority][node % m_queues[priority].size()].push_back(queued);
+	++group.pending;
+	m_mutex.unlock();
+
+	m_workAvailable.notify_all();
+}
+
+
+void WorkerPool::wait(TaskGroup& group)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (group.pending > 0)
+		m_idle.wait(lock);
+}
+
+
+bool WorkerPool::waitFor(TaskGroup& group, int milliseconds)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	return m_idle.wait_for(lock, std::chrono::milliseconds(milliseconds), 
+		[&group] { return group.pending == 0; });
+}
+
+
+int WorkerPool::getNodeCount()
+{
+	return (int) m_nodes.size();
+}
+
+
+int WorkerPool::getWorkerCount()
+{
+	return (int) m_workers.size();
+}
+
+
+bool WorkerPool::isPinned()
+{
+	return m_pinned;
+}
+
+
+// Returns how many tasks have run on a node other than the one they were queued on.
+int WorkerPool::getStealCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_steals;
+}
+
+
+void WorkerPool::resetStealCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_steals = 0;
+}
+
+
+WorkerPool::QueueLatency WorkerPool::getQueueLatency(Priority priority)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	QueueLatency latency;
+	latency.tasks = m_latencyTasks[priority];
+	latency.averageMilliseconds = m_latencyTasks[priority] > 0 ? m_latencyTotal[priority] / m_latencyTasks[priority] : 0.0;
+	latency.worstMilliseconds = m_latencyWorst[priority];
+
+	return latency;
+}
+
+
+void WorkerPool::resetQueueLatency()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (int priority = 0; priority < PRIORITY_COUNT; ++priority)
+	{
+		m_latencyTasks[priority] = 0;
+		m_latencyTotal[priority] = 0.0;
+		m_latencyWorst[priority] = 0.0;
+	}
+}
+
+
+// Takes the most urgent task for a worker on a node. Each class is tried
+// in turn, taking from the front of the node's own queue, so tasks run in
+// the order they were queued, or else stealing from the back of another
+// node's queue. Call with m_mutex held.
+bool WorkerPool::takeTask(int node, Task& task, Priority& priority)
+{
+	for (int i = 0; i < PRIORITY_COUNT; ++i)
+	{
+		std::vector<std::deque<Task> >& queues = m_queues[i];
+		priority = (Priority) i;
+
+		if (!queues[node].empty())
+		{
+			task = queues[node].front();
+			queues[node].pop_front();
+			return true;
+		}
+
+		for (int j = 1; j < (int) queues.size(); ++j)
+		{
+			std::deque<Task>& victim = queues[(node + j) % queues.size()];
+
+			if (!victim.empty())
+			{
+				task = victim.back();
+				victim.pop_back();
+				++m_steals;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+// Runs the most urgent task available, waiting for more when there are none.
+// The time each task spent queued is added to its class's latency.
+void WorkerPool::workerLoop(int node)
+{
+	if (m_pinned)
+		SetThreadGroupAffinity(GetCurrentThread(), &m_nodes[node].affinity, nullptr);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		Task task;
+		Priority priority;
+
+		if (!takeTask(node, task, priority))
+		{
+			if (m_stopping)
+				return;
+
+			m_workAvailable.wait(lock);
+			continue;
+		}
+
+		const double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - task.queued).count();
+		++m_latencyTasks[priority];
+		m_latencyTotal[priority] += latency;
+		m_latencyWorst[priority] = std::max(m_latencyWorst[priority], latency);
+
+		lock.unlock();
+		task.run();
+		lock.lock();
+
+		// The group is not touched once its last task is counted off,
+		// as its owner can destroy it as soon as it sees it finished
+		if (--task.group->pending == 0)
+			m_idle.notify_all();
+	}
+}
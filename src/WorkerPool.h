@@ -0,0 +1,137 @@
+/* WorkerPool.h
+ *
+ * A persistent pool of compute threads, grouped by NUMA node.
+ * Each node has its own task queue, and its workers can optionally be
+ * pinned to the node's processors so that the memory they first touch
+ * stays local. Idle workers steal from other nodes' queues.
+ * Tasks are queued in a priority class. A worker always takes an
+ * interactive task, from any node, before a batch one, so batch work only
+ * runs on capacity interactive work leaves idle. Tasks are never
+ * interrupted, so the size of a batch task bounds how long an interactive
+ * one can wait for a worker.
+ * Each submitter counts its tasks in its own group and waits on that
+ * group, so submitters sharing the pool never wait on each other's work. */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include "windows.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+	enum Priority
+	{
+		INTERACTIVE,
+		BATCH,
+		PRIORITY_COUNT
+	};
+
+	struct Config
+	{
+		// Pins each worker to the processors of its node.
+		bool pinThreads;
+
+		// Number of nodes to use, or 0 for every node.
+		int maxNodes;
+
+		// Number of workers per node, or 0 for one per processor.
+		int workersPerNode;
+	};
+
+	struct Node
+	{
+		unsigned short id;
+		GROUP_AFFINITY affinity;
+		int processorCount;
+	};
+
+	// A submitter's unfinished tasks. Guarded by the pool's mutex.
+	// A group must outlive its tasks, so wait on it before destroying it.
+	struct TaskGroup
+	{
+		TaskGroup() : pending(0) { }
+
+		int pending;
+	};
+
+	// Time tasks spent queued before a worker took them.
+	struct QueueLatency
+	{
+		int tasks;
+		double averageMilliseconds;
+		double worstMilliseconds;
+	};
+
+	WorkerPool();
+	~WorkerPool();
+
+	static std::vector<Node> detectTopology();
+
+	void start(const Config& config);
+	void stop();
+
+	// Queues a task on a node's queue for a priority class, counted in a group.
+	void submit(int node, Priority priority, TaskGroup& group, std::function<void()> task);
+
+	// Blocks until every task queued in a group has finished.
+	void wait(TaskGroup& group);
+
+	// As wait(), but gives up after a number of milliseconds.
+	// Returns true if every task queued in the group has finished.
+	bool waitFor(TaskGroup& group, int milliseconds);
+
+	int getNodeCount();
+	int getWorkerCount();
+	bool isPinned();
+
+	int getStealCount();
+	void resetStealCount();
+
+	QueueLatency getQueueLatency(Priority priority);
+	void resetQueueLatency();
+
+private:
+	struct Task
+	{
+		std::function<void()> run;
+		TaskGroup* group;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	struct Worker
+	{
+		std::thread* thread;
+		int node;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<Worker> m_workers;
+	// Queues by priority class, then by node.
+	std::vector<std::deque<Task> > m_queues[PRIORITY_COUNT];
+
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_idle;
+
+	bool m_stopping;
+	int m_steals;
+	bool m_pinned;
+
+	int m_latencyTasks[PRIORITY_COUNT];
+	double m_latencyTotal[PRIORITY_COUNT];
+	double m_latencyWorst[PRIORITY_COUNT];
+
+	bool takeTask(int node, Task& task, Priority& priority);
+	void workerLoop(int node);
+};
+
+#endif // WORKERPOOL_H
@@ -1,5 +1,7 @@
 #include "MandelbrotViewer.h"
 #include "windows.h"
+#include <sstream>
+#include <string>
 #include <thread>
 
 // Handle to the window
@@ -13,22 +15,37 @@ void logicThreadHandler();
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 void registerWindow(HINSTANCE hInstance);
 bool initWindow(HINSTANCE hInstance, int nCmdShow);
+void parseCommandLine(const char* commandLine, std::string& recordPath, std::string& replayPath, bool& benchmark);
 
 
 // Entry point for the application.
-int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance,
+int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE /* hPrevInstance */,
                     PSTR szCmdLine, int nCmdShow)			
 {	
+	std::string recordPath, replayPath;
+	bool benchmark;
+	parseCommandLine(szCmdLine, recordPath, replayPath, benchmark);
+
 	// Register the window
 	registerWindow(hInstance);
 
-	// Initialize the window, and if it fails, return
-	if (!initWindow(hInstance, nCmdShow))
+	// Initialize the window, and if it fails, return.
+	// Replays are headless, so their window is never shown.
+	if (!initWindow(hInstance, replayPath.empty() ? nCmdShow : SW_HIDE))
 		return 0;
 
 	// Create a new MandelbrotViewer, passing it the handle to the window,
 	// and call the init function.
 	pMandelbrotViewer = new MandelbrotViewer(gHwnd);
+
+	if (!replayPath.empty() && !pMandelbrotViewer->replayInput(replayPath.c_str()))
+		ShowWindow(gHwnd, nCmdShow);
+	else if (!recordPath.empty())
+		pMandelbrotViewer->recordInput(recordPath.c_str());
+
+	if (benchmark)
+		pMandelbrotViewer->runBenchmarks();
+
 	pMandelbrotViewer->init();
 
 	std::thread logicThread(logicThreadHandler);
@@ -79,6 +96,25 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 }
 
 
+// Reads the options "-record <trace>", "-replay <trace>" and "-benchmark".
+void parseCommandLine(const char* commandLine, std::string& recordPath, std::string& replayPath, bool& benchmark)
+{
+	std::istringstream arguments(commandLine);
+	std::string argument;
+	benchmark = false;
+
+	while (arguments >> argument)
+	{
+		if (argument == "-record")
+			arguments >> recordPath;
+		else if (argument == "-replay")
+			arguments >> replayPath;
+		else if (argument == "-benchmark")
+			benchmark = true;
+	}
+}
+
+
 // Register the window.
 void registerWindow(HINSTANCE hInstance)
 {